@@ -28,7 +28,7 @@ if not exist "include\json.hpp" (
     exit /b 1
 )
 
-echo [1/2] Compiling C++ server (local mode)...
+echo [1/4] Compiling C++ server (local mode)...
 g++ -std=c++17 -O2 -o server.exe cpp/server.cpp -Iinclude -Icpp -lws2_32
 
 if %ERRORLEVEL% neq 0 (
@@ -38,10 +38,32 @@ if %ERRORLEVEL% neq 0 (
     exit /b 1
 )
 
-echo [2/2] Build successful!
+echo [2/4] Compiling micro-benchmarks...
+g++ -std=c++17 -O2 -o bench.exe cpp/bench.cpp -Iinclude -Icpp
+
+if %ERRORLEVEL% neq 0 (
+    echo.
+    echo BUILD FAILED!
+    pause
+    exit /b 1
+)
+
+echo [3/4] Compiling load generator...
+g++ -std=c++17 -O2 -o loadgen.exe cpp/loadgen.cpp -Iinclude -Icpp -lws2_32
+
+if %ERRORLEVEL% neq 0 (
+    echo.
+    echo BUILD FAILED!
+    pause
+    exit /b 1
+)
+
+echo [4/4] Build successful!
 echo.
 echo ===============================================
 echo   Run with:  server.exe
+echo   Benchmark: bench.exe  (bench.exe --json for a baseline file)
+echo   Load test: loadgen.exe --users 50 --duration 60  (server must be running)
 echo   Open:      http://localhost:8080
 echo ===============================================
 echo.
@@ -0,0 +1,326 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define BASE64_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// ═══════════════════════════════════════════════════════════
+//  Base64 Encoding / Decoding — standard and URL-safe alphabets
+//  AVX2 / SSE4.1 kernels picked at runtime, scalar fallback
+// ═══════════════════════════════════════════════════════════
+//
+//  Output is sized once up front and written in place. Decoding is
+//  strict: a character outside the alphabet, a misplaced '=', an
+//  impossible length or non-zero padding bits rejects the whole
+//  input (trailing '=' may be omitted). base64_decode and
+//  base64url_decode return "" in that case; the *_into forms say so.
+
+enum class Base64Kernel { Scalar, Sse41, Avx2 };
+
+namespace base64_detail {
+
+struct Alphabet {
+    char enc[64];
+    int8_t dec[256];        // -1 = not in the alphabet
+    // SIMD encoder: ASCII offset per sextet class (see encodeSse41)
+    int8_t encShift[16];
+    // SIMD decoder: a byte is valid when decLo[low nibble] & decHi[high
+    // nibble] is zero; its value is the byte plus decRoll[high nibble], or
+    // plus decRoll[high nibble | 8] for `special`, the one symbol whose
+    // offset differs from the rest of its high-nibble row
+    int8_t decLo[16], decHi[16], decRoll[16];
+    char special;
+};
+
+constexpr Alphabet makeAlphabet(char c62, char c63, const int8_t (&lo)[16], const int8_t (&hi)[16],
+                                const int8_t (&roll)[16], char special) {
+    Alphabet a{};
+    for (int i = 0; i < 256; i++) a.dec[i] = -1;
+    for (int i = 0; i < 64; i++) {
+        char c = i < 26 ? char('A' + i) : i < 52 ? char('a' + i - 26) : i < 62 ? char('0' + i - 52)
+               : i == 62 ? c62 : c63;
+        a.enc[i] = c;
+        a.dec[(unsigned char)c] = (int8_t)i;
+    }
+    a.encShift[0] = 'a' - 26;
+    for (int i = 1; i <= 10; i++) a.encShift[i] = '0' - 52;
+    a.encShift[11] = (int8_t)(c62 - 62);
+    a.encShift[12] = (int8_t)(c63 - 63);
+    a.encShift[13] = 'A';
+    for (int i = 0; i < 16; i++) {
+        a.decLo[i] = lo[i];
+        a.decHi[i] = hi[i];
+        a.decRoll[i] = roll[i];
+    }
+    a.special = special;
+    return a;
+}
+
+// Row classes: 0x01 = 0x2_, 0x02 = digits, 0x04 = 0x4_/0x6_ (letters from
+// 1), 0x08 = 0x5_ (and 0x7_ in the standard alphabet), 0x20 = 0x7_ (URL),
+// 0x10 = rows with no symbols at all
+inline constexpr int8_t STANDARD_LO[16] = {0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A};
+inline constexpr int8_t STANDARD_HI[16] = {0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10};
+inline constexpr int8_t STANDARD_ROLL[16] = {0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 16, 0, 0, 0, 0, 0};
+inline constexpr int8_t URL_LO[16] = {0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                      0x11, 0x11, 0x13, 0x3B, 0x3B, 0x3A, 0x3B, 0x33};
+inline constexpr int8_t URL_HI[16] = {0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x20,
+                                      0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10};
+inline constexpr int8_t URL_ROLL[16] = {0, 0, 17, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, -32, 0, 0};
+
+inline constexpr Alphabet STANDARD = makeAlphabet('+', '/', STANDARD_LO, STANDARD_HI, STANDARD_ROLL, '/');
+inline constexpr Alphabet URL = makeAlphabet('-', '_', URL_LO, URL_HI, URL_ROLL, '_');
+
+inline constexpr size_t INVALID = SIZE_MAX;
+
+// ── Scalar ────────────────────────────────────────────────
+// Encodes all of `in`; the tail group gets '=' padding when `pad` is set
+inline void encodeScalar(const unsigned char* in, size_t n, char* out, const Alphabet& a, bool pad) {
+    size_t i = 0;
+    for (; i + 3 <= n; i += 3, out += 4) {
+        uint32_t v = (uint32_t)in[i] << 16 | (uint32_t)in[i + 1] << 8 | in[i + 2];
+        out[0] = a.enc[v >> 18];
+        out[1] = a.enc[(v >> 12) & 63];
+        out[2] = a.enc[(v >> 6) & 63];
+        out[3] = a.enc[v & 63];
+    }
+    if (i == n) return;
+    uint32_t v = (uint32_t)in[i] << 16 | (i + 1 < n ? (uint32_t)in[i + 1] << 8 : 0);
+    out[0] = a.enc[v >> 18];
+    out[1] = a.enc[(v >> 12) & 63];
+    if (i + 1 < n) out[2] = a.enc[(v >> 6) & 63];
+    else if (pad) out[2] = '=';
+    if (pad) out[3] = '=';
+}
+
+// Decodes `n` symbols (padding already stripped, n % 4 != 1)
+inline bool decodeScalar(const char* in, size_t n, unsigned char* out, const Alphabet& a) {
+    auto val = [&](size_t i) -> int32_t { return a.dec[(unsigned char)in[i]]; };
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4, out += 3) {
+        int32_t v0 = val(i), v1 = val(i + 1), v2 = val(i + 2), v3 = val(i + 3);
+        if ((v0 | v1 | v2 | v3) < 0) return false;
+        uint32_t v = (uint32_t)v0 << 18 | (uint32_t)v1 << 12 | (uint32_t)v2 << 6 | (uint32_t)v3;
+        out[0] = (unsigned char)(v >> 16);
+        out[1] = (unsigned char)(v >> 8);
+        out[2] = (unsigned char)v;
+    }
+    if (i == n) return true;
+    int32_t v0 = val(i), v1 = val(i + 1), v2 = n - i == 3 ? val(i + 2) : 0;
+    if ((v0 | v1 | v2) < 0) return false;
+    out[0] = (unsigned char)(v0 << 2 | v1 >> 4);
+    if (n - i == 2) return (v1 & 0x0f) == 0;
+    out[1] = (unsigned char)((v1 & 0x0f) << 4 | v2 >> 2);
+    return (v2 & 0x03) == 0;
+}
+
+#ifdef BASE64_X86_SIMD
+// ── SSE4.1 ────────────────────────────────────────────────
+// Encode: spread each 3-byte group over a 32-bit lane, cut it into four
+// sextets with multiplies, then map sextet classes (A-Z, a-z, 0-9, 62,
+// 63) to ASCII offsets with one byte shuffle. Returns bytes consumed.
+__attribute__((target("sse4.1"))) inline size_t encodeSse41(const unsigned char* in, size_t n, char* out,
+                                                            const Alphabet& a) {
+    const __m128i spread = _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m128i shiftLut = _mm_loadu_si128((const __m128i*)a.encShift);
+    size_t i = 0;
+    // Loads 16 bytes to encode 12
+    for (; i + 16 <= n; i += 12, out += 16) {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + i)), spread);
+        __m128i hi = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+        __m128i lo = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+        __m128i idx = _mm_or_si128(hi, lo);
+        __m128i cls = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+        cls = _mm_or_si128(cls, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+        _mm_storeu_si128((__m128i*)out, _mm_add_epi8(idx, _mm_shuffle_epi8(shiftLut, cls)));
+    }
+    return i;
+}
+
+// Decode: validate and translate 16 symbols with the nibble tables, merge
+// sextet pairs and pairs of pairs with multiply-adds, then gather the 12
+// payload bytes. Returns symbols consumed, or INVALID.
+__attribute__((target("sse4.1"))) inline size_t decodeSse41(const char* in, size_t n, unsigned char* out,
+                                                            const Alphabet& a) {
+    const __m128i lutLo = _mm_loadu_si128((const __m128i*)a.decLo);
+    const __m128i lutHi = _mm_loadu_si128((const __m128i*)a.decHi);
+    const __m128i lutRoll = _mm_loadu_si128((const __m128i*)a.decRoll);
+    const __m128i special = _mm_set1_epi8(a.special), nibble = _mm_set1_epi8(0x0f);
+    const __m128i gather = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16, out += 12) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+        __m128i hi = _mm_and_si128(_mm_srli_epi32(v, 4), nibble);
+        __m128i lo = _mm_and_si128(v, nibble);
+        if (!_mm_testz_si128(_mm_shuffle_epi8(lutLo, lo), _mm_shuffle_epi8(lutHi, hi))) return INVALID;
+        __m128i row = _mm_or_si128(hi, _mm_and_si128(_mm_cmpeq_epi8(v, special), _mm_set1_epi8(8)));
+        v = _mm_add_epi8(v, _mm_shuffle_epi8(lutRoll, row));
+        v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+        v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+        v = _mm_shuffle_epi8(v, gather);
+        _mm_storel_epi64((__m128i*)out, v);
+        uint32_t last = (uint32_t)_mm_extract_epi32(v, 2);
+        std::memcpy(out + 8, &last, 4);
+    }
+    return i;
+}
+
+// ── AVX2 ──────────────────────────────────────────────────
+// The same steps on two 128-bit lanes at once
+__attribute__((target("avx2"))) inline size_t encodeAvx2(const unsigned char* in, size_t n, char* out,
+                                                         const Alphabet& a) {
+    const __m256i spread = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                            1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i shiftLut = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)a.encShift));
+    size_t i = 0;
+    // Lane 1 starts 12 bytes in, so 28 bytes are read to encode 24
+    for (; i + 28 <= n; i += 24, out += 32) {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in + i))),
+                                            _mm_loadu_si128((const __m128i*)(in + i + 12)), 1);
+        v = _mm256_shuffle_epi8(v, spread);
+        __m256i hi = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00)),
+                                        _mm256_set1_epi32(0x04000040));
+        __m256i lo = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0)),
+                                        _mm256_set1_epi32(0x01000010));
+        __m256i idx = _mm256_or_si256(hi, lo);
+        __m256i cls = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+        cls = _mm256_or_si256(cls, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx),
+                                                    _mm256_set1_epi8(13)));
+        _mm256_storeu_si256((__m256i*)out, _mm256_add_epi8(idx, _mm256_shuffle_epi8(shiftLut, cls)));
+    }
+    return i;
+}
+
+__attribute__((target("avx2"))) inline size_t decodeAvx2(const char* in, size_t n, unsigned char* out,
+                                                         const Alphabet& a) {
+    const __m256i lutLo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)a.decLo));
+    const __m256i lutHi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)a.decHi));
+    const __m256i lutRoll = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)a.decRoll));
+    const __m256i special = _mm256_set1_epi8(a.special), nibble = _mm256_set1_epi8(0x0f);
+    const __m256i gather = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i joinLanes = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32, out += 24) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(in + i));
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi32(v, 4), nibble);
+        __m256i lo = _mm256_and_si256(v, nibble);
+        if (!_mm256_testz_si256(_mm256_shuffle_epi8(lutLo, lo), _mm256_shuffle_epi8(lutHi, hi))) return INVALID;
+        __m256i row = _mm256_or_si256(hi, _mm256_and_si256(_mm256_cmpeq_epi8(v, special), _mm256_set1_epi8(8)));
+        v = _mm256_add_epi8(v, _mm256_shuffle_epi8(lutRoll, row));
+        v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+        v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+        v = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(v, gather), joinLanes);
+        _mm_storeu_si128((__m128i*)out, _mm256_castsi256_si128(v));
+        _mm_storel_epi64((__m128i*)(out + 16), _mm256_extracti128_si256(v, 1));
+    }
+    return i;
+}
+#endif
+
+// ── Drivers ───────────────────────────────────────────────
+inline std::string encode(std::string_view in, const Alphabet& a, bool pad, Base64Kernel kernel) {
+    size_t n = in.size();
+    std::string out(pad ? (n + 2) / 3 * 4 : n / 3 * 4 + (n % 3 ? n % 3 + 1 : 0), '\0');
+    const unsigned char* src = (const unsigned char*)in.data();
+    char* dst = &out[0];
+    size_t done = 0;
+#ifdef BASE64_X86_SIMD
+    if (kernel == Base64Kernel::Avx2) done = encodeAvx2(src, n, dst, a);
+    if (kernel != Base64Kernel::Scalar) done += encodeSse41(src + done, n - done, dst + done / 3 * 4, a);
+#else
+    (void)kernel;
+#endif
+    encodeScalar(src + done, n - done, dst + done / 3 * 4, a, pad);
+    return out;
+}
+
+inline bool decode(std::string_view in, std::string& out, const Alphabet& a, Base64Kernel kernel) {
+    size_t n = in.size();
+    if (n % 4 == 0 && n > 0 && in[n - 1] == '=') {
+        n--;
+        if (in[n - 1] == '=') n--;
+    }
+    if (n % 4 == 1) { out.clear(); return false; }
+    out.resize(n / 4 * 3 + (n % 4 ? n % 4 - 1 : 0));
+    const char* src = in.data();
+    unsigned char* dst = (unsigned char*)&out[0];
+    size_t done = 0;
+#ifdef BASE64_X86_SIMD
+    if (kernel == Base64Kernel::Avx2) done = decodeAvx2(src, n, dst, a);
+    if (done != INVALID && kernel != Base64Kernel::Scalar) {
+        size_t more = decodeSse41(src + done, n - done, dst + done / 4 * 3, a);
+        done = more == INVALID ? INVALID : done + more;
+    }
+#else
+    (void)kernel;
+#endif
+    if (done == INVALID || !decodeScalar(src + done, n - done, dst + done / 4 * 3, a)) {
+        out.clear();
+        return false;
+    }
+    return true;
+}
+
+} // namespace base64_detail
+
+// ── Runtime dispatch ──────────────────────────────────────
+inline Base64Kernel detectBase64Kernel() {
+#ifdef BASE64_X86_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return Base64Kernel::Avx2;
+    if (__builtin_cpu_supports("sse4.1")) return Base64Kernel::Sse41;
+#endif
+    return Base64Kernel::Scalar;
+}
+
+inline Base64Kernel base64Kernel() {
+    static const Base64Kernel kernel = detectBase64Kernel();
+    return kernel;
+}
+
+inline const char* base64KernelName(Base64Kernel kernel = base64Kernel()) {
+    switch (kernel) {
+    case Base64Kernel::Avx2: return "avx2";
+    case Base64Kernel::Sse41: return "sse4.1";
+    default: return "scalar";
+    }
+}
+
+// ── Public API ────────────────────────────────────────────
+inline std::string base64_encode(std::string_view in) {
+    return base64_detail::encode(in, base64_detail::STANDARD, true, base64Kernel());
+}
+
+inline bool base64_decode_into(std::string_view in, std::string& out) {
+    return base64_detail::decode(in, out, base64_detail::STANDARD, base64Kernel());
+}
+
+inline std::string base64_decode(std::string_view in) {
+    std::string out;
+    base64_decode_into(in, out);
+    return out;
+}
+
+// Unpadded on output; padding is accepted but not required on input
+inline std::string base64url_encode(std::string_view data) {
+    return base64_detail::encode(data, base64_detail::URL, false, base64Kernel());
+}
+
+inline bool base64url_decode_into(std::string_view data, std::string& out) {
+    return base64_detail::decode(data, out, base64_detail::URL, base64Kernel());
+}
+
+inline std::string base64url_decode(std::string_view data) {
+    std::string out;
+    base64url_decode_into(data, out);
+    return out;
+}
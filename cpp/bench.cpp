@@ -0,0 +1,270 @@
+// ═══════════════════════════════════════════════════════════
+//  ChatApp Logger — Micro-benchmarks
+//  base64 · AES-256 · JWT · Message JSON · Queue
+// ═══════════════════════════════════════════════════════════
+//
+//  ./bench                      table on stdout
+//  ./bench --json > base.json   machine-readable, for regression diffs
+//  ./bench --filter aes --min-ms 200
+//
+//  Each case is calibrated to run for at least --min-ms, measured
+//  three times, and the fastest run is reported: ns/op, bytes/s
+//  (for cases with a payload) and heap allocations per op.
+
+#include "json.hpp"
+#include "queue.hpp"
+#include "base64.hpp"
+#include "crypto.hpp"
+#include "message.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using json = nlohmann::json;
+
+// ── Allocation counting ───────────────────────────────────
+// Kept out of line: once inlined, GCC pairs the malloc/free inside with
+// the new/delete at the call site and warns about a mismatch.
+#if defined(__GNUC__) || defined(__clang__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+static std::atomic<uint64_t> allocations{0};
+
+BENCH_NOINLINE void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+BENCH_NOINLINE void* operator new[](size_t size) { return operator new(size); }
+BENCH_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete[](void* p) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void* p, size_t) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+// Keeps the optimizer from discarding a result
+template<typename T>
+inline void keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static volatile const void* sink;
+    sink = &value;
+#endif
+}
+
+// ── Harness ───────────────────────────────────────────────
+struct Options {
+    std::string filter;
+    double minMs = 100;
+    bool asJson = false;
+};
+
+struct Result {
+    std::string name;
+    size_t bytes;           // payload per op; 0 = not a throughput case
+    uint64_t iterations;
+    double nsPerOp;
+    double bytesPerSec;
+    double allocsPerOp;
+};
+
+class Bench {
+    Options opt_;
+    std::vector<Result> results_;
+
+    // Runs `iters` calls and returns {elapsed ns, allocations}
+    static std::pair<double, uint64_t> timeRun(const std::function<void()>& fn, uint64_t iters) {
+        uint64_t allocBefore = allocations.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iters; i++) fn();
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        return {std::chrono::duration<double, std::nano>(elapsed).count(),
+                allocations.load(std::memory_order_relaxed) - allocBefore};
+    }
+
+public:
+    explicit Bench(Options opt) : opt_(std::move(opt)) {}
+
+    void run(const std::string& name, size_t bytes, const std::function<void()>& fn) {
+        if (!opt_.filter.empty() && name.find(opt_.filter) == std::string::npos) return;
+
+        // Calibrate: double the count until one run takes minMs
+        double minNs = opt_.minMs * 1e6;
+        uint64_t iters = 1;
+        fn();
+        for (;;) {
+            double ns = timeRun(fn, iters).first;
+            if (ns >= minNs || iters >= (1ull << 40)) break;
+            iters = ns < minNs / 64 ? iters * 8 : (uint64_t)(iters * (minNs / std::max(ns, 1.0)) * 1.1) + 1;
+        }
+
+        double bestNs = 0;
+        uint64_t allocs = 0;
+        for (int round = 0; round < 3; round++) {
+            auto [ns, a] = timeRun(fn, iters);
+            if (round == 0 || ns < bestNs) bestNs = ns;
+            allocs = a;
+        }
+
+        Result r{name, bytes, iters, bestNs / iters,
+                 bytes ? bytes * (double)iters / (bestNs / 1e9) : 0, (double)allocs / iters};
+        results_.push_back(r);
+        if (!opt_.asJson) {
+            char rate[32] = "         -     ";
+            if (bytes) snprintf(rate, sizeof(rate), "%10.1f MB/s", r.bytesPerSec / 1e6);
+            char line[160];
+            snprintf(line, sizeof(line), "%-34s %12.1f ns/op %s %8.2f allocs/op\n",
+                     name.c_str(), r.nsPerOp, rate, r.allocsPerOp);
+            std::cout << line << std::flush;
+        }
+    }
+
+    void report() const {
+        if (!opt_.asJson) return;
+        json out = json::array();
+        for (auto& r : results_) {
+            out.push_back({{"name", r.name}, {"bytes", r.bytes}, {"iterations", r.iterations},
+                           {"nsPerOp", r.nsPerOp}, {"bytesPerSec", r.bytesPerSec},
+                           {"allocsPerOp", r.allocsPerOp}});
+        }
+        json meta = {
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+            {"openssl", true},
+#else
+            {"openssl", false},
+#endif
+            {"base64Kernel", base64KernelName()},
+            {"minMs", opt_.minMs}
+        };
+        std::cout << json({{"meta", meta}, {"results", out}}).dump(2) << std::endl;
+    }
+};
+
+// ── Fixtures ──────────────────────────────────────────────
+static const size_t PAYLOAD_SIZES[] = {16, 256, 4096, 65536};
+
+std::string payload(size_t n) {
+    std::string s(n, '\0');
+    uint32_t x = 2463534242u;
+    for (auto& c : s) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5;
+        c = (char)(' ' + x % 95);  // printable, like chat text
+    }
+    return s;
+}
+
+Message sampleMessage(size_t contentBytes) {
+    Message m{"1700000000000_42", "alice@example.com", "Alice", "https://example.com/a.png",
+              "global", "", payload(contentBytes), "global", 1700000000000};
+    m.seq = 42;
+    return m;
+}
+
+// ── Cases ─────────────────────────────────────────────────
+void benchBase64(Bench& b) {
+    for (size_t n : PAYLOAD_SIZES) {
+        std::string raw = payload(n);
+        std::string enc = base64_encode(raw);
+        std::string urlEnc = base64url_encode(raw);
+        std::string sz = "/" + std::to_string(n);
+        b.run("base64_encode" + sz, n, [&] { keep(base64_encode(raw)); });
+        b.run("base64_decode" + sz, n, [&] { keep(base64_decode(enc)); });
+        b.run("base64url_encode" + sz, n, [&] { keep(base64url_encode(raw)); });
+        b.run("base64url_decode" + sz, n, [&] { keep(base64url_decode(urlEnc)); });
+    }
+    // The portable path, for the speed-up of the dispatched kernel
+    using namespace base64_detail;
+    std::string raw = payload(4096), enc = base64_encode(raw), out;
+    b.run("base64_encode/4096 (scalar)", 4096, [&] { keep(encode(raw, STANDARD, true, Base64Kernel::Scalar)); });
+    b.run("base64_decode/4096 (scalar)", 4096, [&] { decode(enc, out, STANDARD, Base64Kernel::Scalar); keep(out); });
+}
+
+void benchAes(Bench& b) {
+    const std::string key = "benchmark-encryption-key";
+    for (size_t n : PAYLOAD_SIZES) {
+        std::string plain = payload(n);
+        std::string cipher = aes_encrypt(plain, key);
+        std::string sz = "/" + std::to_string(n);
+        b.run("aes_encrypt" + sz, n, [&] { keep(aes_encrypt(plain, key)); });
+        b.run("aes_decrypt" + sz, n, [&] { keep(aes_decrypt(cipher, key)); });
+    }
+}
+
+void benchJwt(Bench& b) {
+    const std::string secret = "benchmark-jwt-secret";
+    json claims = {{"googleId", "104857600000000000000"}, {"email", "alice@example.com"},
+                   {"name", "Alice Example"}, {"avatar", "https://lh3.googleusercontent.com/a/abc=s96-c"},
+                   {"exp", (int64_t)std::time(nullptr) + 7 * 24 * 3600}};
+    std::string token = create_jwt(claims, secret);
+    b.run("create_jwt", token.size(), [&] { keep(create_jwt(claims, secret)); });
+    b.run("verify_jwt", token.size(), [&] { keep(verify_jwt(token, secret)); });
+}
+
+void benchMessage(Bench& b) {
+    for (size_t n : {16, 256, 4096}) {
+        Message m = sampleMessage(n);
+        Message sealed = m;
+        sealed.seal();
+        std::vector<Message> page(100, sealed);
+        std::string sz = "/" + std::to_string(n);
+        b.run("Message::toJson" + sz, n, [&] { keep(m.toJson()); });
+        b.run("Message::toJson.dump" + sz, n, [&] { keep(m.toJson().dump()); });
+        b.run("Message::seal" + sz, n, [&] { Message c = m; c.seal(); keep(c); });
+        b.run("appendMessageArray/100x" + std::to_string(n), 100 * n, [&] {
+            std::string out;
+            appendMessageArray(out, page);
+            keep(out);
+        });
+    }
+}
+
+void benchQueue(Bench& b) {
+    Message m = sampleMessage(64);
+    m.seal();
+    {
+        Queue<Message> q(10);
+        for (int i = 0; i < 1000; i++) q.enqueue(m);
+        b.run("Queue::enqueue+dequeue", 0, [&] { q.enqueue(m); keep(q.dequeue()); });
+        b.run("Queue::getLast(10)", 0, [&] { keep(q.getLast(10)); });
+    }
+    {
+        RingQueue<Message> ring(10);
+        for (int i = 0; i < 10; i++) ring.enqueue(m);
+        b.run("RingQueue::enqueue", 0, [&] { ring.enqueue(m); });
+        b.run("RingQueue::getLast(10)", 0, [&] { keep(ring.getLast(10)); });
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--json") opt.asJson = true;
+        else if (arg == "--filter" && i + 1 < argc) opt.filter = argv[++i];
+        else if (arg == "--min-ms" && i + 1 < argc) opt.minMs = std::max(1.0, std::atof(argv[++i]));
+        else {
+            std::cerr << "usage: bench [--json] [--filter substring] [--min-ms N]" << std::endl;
+            return 2;
+        }
+    }
+
+    Bench bench(opt);
+    benchBase64(bench);
+    benchAes(bench);
+    benchJwt(bench);
+    benchMessage(bench);
+    benchQueue(bench);
+    bench.report();
+    return 0;
+}
@@ -0,0 +1,212 @@
+#pragma once
+#include <string>
+#include <cctype>
+#include <cstdlib>
+#include <cstdint>
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USE_BROTLI
+#include <brotli/encode.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+// ═══════════════════════════════════════════════════════════
+//  Response Compression — gzip (USE_ZLIB) · brotli (USE_BROTLI)
+//  · zstd (USE_ZSTD). Encoders return an empty string when a codec
+//  is not built in or fails, so callers fall back to identity.
+// ═══════════════════════════════════════════════════════════
+
+enum class ContentEncoding { Identity, Gzip, Brotli, Zstd };
+
+inline const char* encodingName(ContentEncoding e) {
+    switch (e) {
+    case ContentEncoding::Gzip: return "gzip";
+    case ContentEncoding::Brotli: return "br";
+    case ContentEncoding::Zstd: return "zstd";
+    default: return "identity";
+    }
+}
+
+// ── Encoders ──────────────────────────────────────────────
+inline std::string gzipCompress(const std::string& in, int level = 9) {
+#ifdef USE_ZLIB
+    z_stream zs{};
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) return {};
+    std::string out(deflateBound(&zs, (uLong)in.size()), '\0');
+    zs.next_in = (Bytef*)in.data();
+    zs.avail_in = (uInt)in.size();
+    zs.next_out = (Bytef*)&out[0];
+    zs.avail_out = (uInt)out.size();
+    int rc = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return rc == Z_STREAM_END ? out : std::string();
+#else
+    (void)in; (void)level;
+    return {};
+#endif
+}
+
+inline std::string brotliCompress(const std::string& in, int quality = 11) {
+#ifdef USE_BROTLI
+    size_t size = BrotliEncoderMaxCompressedSize(in.size());
+    if (size == 0) return {};
+    std::string out(size, '\0');
+    if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT, in.size(),
+                               (const uint8_t*)in.data(), &size, (uint8_t*)&out[0]))
+        return {};
+    out.resize(size);
+    return out;
+#else
+    (void)in; (void)quality;
+    return {};
+#endif
+}
+
+inline std::string zstdCompress(const std::string& in, int level = 3) {
+#ifdef USE_ZSTD
+    std::string out(ZSTD_compressBound(in.size()), '\0');
+    size_t n = ZSTD_compress(&out[0], out.size(), in.data(), in.size(), level);
+    if (ZSTD_isError(n)) return {};
+    out.resize(n);
+    return out;
+#else
+    (void)in; (void)level;
+    return {};
+#endif
+}
+
+// Levels tuned for per-request use; static assets use the maximums above
+inline std::string compressDynamic(ContentEncoding e, const std::string& in) {
+    switch (e) {
+    case ContentEncoding::Gzip: return gzipCompress(in, 6);
+    case ContentEncoding::Zstd: return zstdCompress(in, 3);
+    case ContentEncoding::Brotli: return brotliCompress(in, 5);
+    default: return {};
+    }
+}
+
+// ── Streaming encoder (chunked responses) ─────────────────
+// Feed successive chunks through update(); the call with finish=true
+// also emits the trailer. Identity passes data through unchanged.
+class StreamEncoder {
+private:
+    ContentEncoding enc_;
+#ifdef USE_ZLIB
+    z_stream zs_{};
+#endif
+#ifdef USE_ZSTD
+    ZSTD_CCtx* zcs_ = nullptr;
+#endif
+
+public:
+    explicit StreamEncoder(ContentEncoding enc) : enc_(ContentEncoding::Identity) {
+        (void)enc;
+#ifdef USE_ZLIB
+        if (enc == ContentEncoding::Gzip &&
+            deflateInit2(&zs_, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+            enc_ = enc;
+#endif
+#ifdef USE_ZSTD
+        if (enc == ContentEncoding::Zstd && (zcs_ = ZSTD_createCCtx()) != nullptr) {
+            ZSTD_CCtx_setParameter(zcs_, ZSTD_c_compressionLevel, 3);
+            enc_ = enc;
+        }
+#endif
+    }
+
+    ~StreamEncoder() {
+#ifdef USE_ZLIB
+        if (enc_ == ContentEncoding::Gzip) deflateEnd(&zs_);
+#endif
+#ifdef USE_ZSTD
+        if (zcs_) ZSTD_freeCCtx(zcs_);
+#endif
+    }
+
+    StreamEncoder(const StreamEncoder&) = delete;
+    StreamEncoder& operator=(const StreamEncoder&) = delete;
+
+    // The encoding actually in effect (Identity if the codec is unavailable)
+    ContentEncoding encoding() const { return enc_; }
+
+    std::string update(const std::string& in, bool finish) {
+        std::string out;
+#ifdef USE_ZLIB
+        if (enc_ == ContentEncoding::Gzip) {
+            zs_.next_in = (Bytef*)in.data();
+            zs_.avail_in = (uInt)in.size();
+            char buf[16384];
+            int rc;
+            do {
+                zs_.next_out = (Bytef*)buf;
+                zs_.avail_out = sizeof(buf);
+                rc = deflate(&zs_, finish ? Z_FINISH : Z_NO_FLUSH);
+                out.append(buf, sizeof(buf) - zs_.avail_out);
+            } while (zs_.avail_out == 0 || (finish && rc == Z_OK));
+            return out;
+        }
+#endif
+#ifdef USE_ZSTD
+        if (enc_ == ContentEncoding::Zstd) {
+            ZSTD_inBuffer input{in.data(), in.size(), 0};
+            char buf[16384];
+            size_t remaining;
+            do {
+                ZSTD_outBuffer output{buf, sizeof(buf), 0};
+                remaining = ZSTD_compressStream2(zcs_, &output, &input, finish ? ZSTD_e_end : ZSTD_e_continue);
+                if (ZSTD_isError(remaining)) break;
+                out.append(buf, output.pos);
+            } while (finish ? remaining != 0 : input.pos < input.size);
+            return out;
+        }
+#endif
+        (void)finish;
+        return in;
+    }
+};
+
+// ── Negotiation ───────────────────────────────────────────
+// True when an Accept-Encoding header lists `name` (or `*`) with q > 0
+inline bool acceptsEncoding(const std::string& header, const char* name) {
+    bool wildcard = false;
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t end = header.find(',', pos);
+        if (end == std::string::npos) end = header.size();
+        std::string item = header.substr(pos, end - pos);
+        pos = end + 1;
+
+        size_t semi = item.find(';');
+        std::string token = item.substr(0, semi);
+        token.erase(0, token.find_first_not_of(" \t"));
+        token.erase(token.find_last_not_of(" \t") + 1);
+        for (auto& c : token) c = (char)std::tolower((unsigned char)c);
+
+        bool allowed = true;
+        if (semi != std::string::npos) {
+            size_t q = item.find("q=", semi);
+            if (q != std::string::npos) allowed = std::atof(item.c_str() + q + 2) > 0;
+        }
+        if (token == name) return allowed;
+        if (token == "*") wildcard = allowed;
+    }
+    return wildcard;
+}
+
+// Encoding for responses compressed per request: zstd is the cheapest to
+// produce at a useful ratio, gzip is understood everywhere
+inline ContentEncoding negotiateDynamic(const std::string& acceptEncoding) {
+#ifdef USE_ZSTD
+    if (acceptsEncoding(acceptEncoding, "zstd")) return ContentEncoding::Zstd;
+#endif
+#ifdef USE_ZLIB
+    if (acceptsEncoding(acceptEncoding, "gzip")) return ContentEncoding::Gzip;
+#endif
+    (void)acceptEncoding;
+    return ContentEncoding::Identity;
+}
@@ -0,0 +1,195 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <functional>
+#include <ctime>
+#include <cstdint>
+
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#endif
+
+#include "json.hpp"
+#include "base64.hpp"
+#include "metrics.hpp"
+#include "lru_cache.hpp"
+
+using json = nlohmann::json;
+
+// ═══════════════════════════════════════════════════════════
+//  Crypto — AES-256 message encryption · HS256 session tokens
+//  Without OpenSSL, AES degrades to plain base64 and JWTs to
+//  an unkeyed hash (local development only).
+// ═══════════════════════════════════════════════════════════
+
+// ── AES-256 (OpenSSL, CryptoJS compatible) ────────────────
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+// ── Key/IV cache ──────────────────────────────────────────
+// Every stored ciphertext carries its own random salt, so (passphrase, salt)
+// pins down one message's key/IV. Re-reading that message on later polls
+// and reloads then skips the EVP_BytesToKey (MD5) derivation.
+struct DerivedKey {
+    unsigned char key[32];
+    unsigned char iv[16];
+};
+
+class KeyCache {
+    static const size_t SHARDS = 16;
+    static const size_t MAX_PER_SHARD = 4096;
+    struct Shard : LruCache<std::string, DerivedKey> {
+        Shard() : LruCache(MAX_PER_SHARD, [](const std::string&, const DerivedKey&) { return (size_t)1; }) {}
+    };
+    Shard shards_[SHARDS];
+
+public:
+    static DerivedKey derive(const unsigned char* salt, const std::string& passphrase) {
+        DerivedKey dk;
+        EVP_BytesToKey(EVP_aes_256_cbc(), EVP_md5(), salt,
+                       (const unsigned char*)passphrase.c_str(), passphrase.size(), 1, dk.key, dk.iv);
+        return dk;
+    }
+
+    // For decryption only: a fresh encryption salt is never seen again
+    DerivedKey get(const unsigned char* salt, const std::string& passphrase) {
+        std::string id((const char*)salt, 8);
+        id += passphrase;
+        Shard& shard = shards_[std::hash<std::string>{}(id) % SHARDS];
+        DerivedKey dk;
+        if (shard.get(id, dk)) return dk;
+        dk = derive(salt, passphrase);
+        shard.put(id, dk);
+        return dk;
+    }
+};
+
+inline KeyCache keyCache;
+
+// One cipher context per thread, re-initialized (not reallocated) per call
+inline EVP_CIPHER_CTX* threadCipherCtx() {
+    thread_local std::unique_ptr<EVP_CIPHER_CTX, decltype(&EVP_CIPHER_CTX_free)>
+        ctx(EVP_CIPHER_CTX_new(), &EVP_CIPHER_CTX_free);
+    return ctx.get();
+}
+
+inline const Metrics::Histogram aesEncryptTime =
+    latencyMetric("chat_aes_duration_seconds", "AES-256-CBC time per message, base64 included", "op=\"encrypt\"");
+inline const Metrics::Histogram aesDecryptTime =
+    latencyMetric("chat_aes_duration_seconds", "AES-256-CBC time per message, base64 included", "op=\"decrypt\"");
+inline const Metrics::Counter aesEncryptBytes =
+    metrics.counter("chat_aes_bytes_total", "Plaintext bytes encrypted or decrypted", "op=\"encrypt\"");
+inline const Metrics::Counter aesDecryptBytes =
+    metrics.counter("chat_aes_bytes_total", "Plaintext bytes encrypted or decrypted", "op=\"decrypt\"");
+
+inline std::string aes_encrypt(const std::string& plaintext, const std::string& passphrase) {
+    Metrics::Timer timer(metrics, aesEncryptTime);
+    metrics.add(aesEncryptBytes, plaintext.size());
+    unsigned char salt[8];
+    RAND_bytes(salt, 8);
+
+    DerivedKey dk = KeyCache::derive(salt, passphrase);
+    EVP_CIPHER_CTX* ctx = threadCipherCtx();
+    EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, dk.key, dk.iv);
+
+    std::vector<unsigned char> ct(plaintext.size() + 32);
+    int len = 0, total = 0;
+    EVP_EncryptUpdate(ctx, ct.data(), &len, (const unsigned char*)plaintext.c_str(), plaintext.size());
+    total = len;
+    EVP_EncryptFinal_ex(ctx, ct.data() + len, &len);
+    total += len;
+
+    std::string raw = "Salted__";
+    raw.append((char*)salt, 8);
+    raw.append((char*)ct.data(), total);
+    return base64_encode(raw);
+}
+
+inline std::string aes_decrypt(const std::string& encoded, const std::string& passphrase) {
+    Metrics::Timer timer(metrics, aesDecryptTime);
+    try {
+        std::string raw = base64_decode(encoded);
+        if (raw.size() < 16 || raw.compare(0, 8, "Salted__") != 0) return "[decryption failed]";
+
+        DerivedKey dk = keyCache.get((const unsigned char*)raw.data() + 8, passphrase);
+        EVP_CIPHER_CTX* ctx = threadCipherCtx();
+        EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, dk.key, dk.iv);
+
+        // Decrypt straight out of `raw`, past the 16-byte "Salted__" header
+        const unsigned char* ct = (const unsigned char*)raw.data() + 16;
+        int ctLen = (int)raw.size() - 16;
+        std::string pt(ctLen + 32, '\0');
+        int len = 0, total = 0;
+        EVP_DecryptUpdate(ctx, (unsigned char*)&pt[0], &len, ct, ctLen);
+        total = len;
+        EVP_DecryptFinal_ex(ctx, (unsigned char*)&pt[0] + len, &len);
+        total += len;
+        pt.resize(total);
+        metrics.add(aesDecryptBytes, pt.size());
+        return pt;
+    } catch (...) {
+        return "[decryption failed]";
+    }
+}
+#else
+// Fallback: no encryption
+inline std::string aes_encrypt(const std::string& plaintext, const std::string&) { return base64_encode(plaintext); }
+inline std::string aes_decrypt(const std::string& encoded, const std::string&) { return base64_decode(encoded); }
+#endif
+
+// ── JWT (HS256) — Create & Verify ─────────────────────────
+inline std::string jwt_sign(const std::string& input, const std::string& secret) {
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+    unsigned char hmac[EVP_MAX_MD_SIZE];
+    unsigned int hmacLen;
+    HMAC(EVP_sha256(), secret.c_str(), secret.size(),
+         (unsigned char*)input.c_str(), input.size(), hmac, &hmacLen);
+    return base64url_encode(std::string((char*)hmac, hmacLen));
+#else
+    // Simple hash fallback (NOT secure, for local dev only)
+    size_t h = std::hash<std::string>{}(input + secret);
+    return base64url_encode(std::to_string(h));
+#endif
+}
+
+inline std::string create_jwt(const json& payload, const std::string& secret) {
+    json header = {{"alg", "HS256"}, {"typ", "JWT"}};
+    std::string h = base64url_encode(header.dump());
+    std::string p = base64url_encode(payload.dump());
+    std::string sig = jwt_sign(h + "." + p, secret);
+    return h + "." + p + "." + sig;
+}
+
+// Compares without an early exit so timing does not leak the matching prefix
+inline bool constantTimeEquals(const std::string& a, const std::string& b) {
+    if (a.size() != b.size()) return false;
+    unsigned char diff = 0;
+    for (size_t i = 0; i < a.size(); i++) diff |= (unsigned char)(a[i] ^ b[i]);
+    return diff == 0;
+}
+
+inline const Metrics::Histogram jwtVerifyTime =
+    latencyMetric("chat_jwt_verify_duration_seconds", "Session token verification time (cache misses)");
+
+inline json verify_jwt(const std::string& token, const std::string& secret) {
+    Metrics::Timer timer(metrics, jwtVerifyTime);
+    auto d1 = token.find('.');
+    auto d2 = token.find('.', d1 + 1);
+    if (d1 == std::string::npos || d2 == std::string::npos) return nullptr;
+
+    std::string sigInput = token.substr(0, d2);
+    std::string sig = token.substr(d2 + 1);
+    if (!constantTimeEquals(jwt_sign(sigInput, secret), sig)) return nullptr;
+
+    std::string payloadStr = base64url_decode(token.substr(d1 + 1, d2 - d1 - 1));
+    json payload = json::parse(payloadStr, nullptr, false);
+    if (payload.is_discarded()) return nullptr;
+
+    if (payload.contains("exp") && payload["exp"].get<int64_t>() < std::time(nullptr))
+        return nullptr;
+
+    return payload;
+}
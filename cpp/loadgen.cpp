@@ -0,0 +1,399 @@
+// ═══════════════════════════════════════════════════════════
+//  ChatApp Logger — Load Generator
+//  Replays the browser client's traffic against a running server
+// ═══════════════════════════════════════════════════════════
+//
+//  ./loadgen --port 8080 --users 200 --duration 120 --send-rate 20
+//  ./loadgen --poll interval      # 3.5 s /api/messages polling instead
+//  ./loadgen --json > run.json    # machine-readable report
+//
+//  Every synthetic user logs in through /api/auth/simple (so the
+//  target must be a local-mode build), loads the newest page, then
+//  follows public/app.js: one live-update loop per user, /api/users
+//  every 12 s, and an occasional /api/download. Sends are open-loop
+//  at --send-rate per second across all users, --dm-share of them
+//  to a random other user. Latency is recorded per route and
+//  reported as throughput and p50/p95/p99/p99.9.
+
+#include "httplib.h"
+#include "json.hpp"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+// ── Options ───────────────────────────────────────────────
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int users = 50;
+    double durationSec = 60;
+    double sendRate = 2;            // messages per second, all users together
+    double dmShare = 0.2;           // fraction of sends that are DMs
+    bool longPoll = true;           // app.js: /api/messages/wait; else interval polling
+    double pollIntervalSec = 3.5;
+    double usersEverySec = 12;      // app.js refreshes the user list on this period
+    double downloadEverySec = 300;  // mean per-user gap between exports
+    int workers = 16;               // threads for sends, user lists and exports
+    std::string prefix = "load";
+    bool asJson = false;
+};
+
+// ── Latency recording ─────────────────────────────────────
+class RouteStats {
+    struct Samples {
+        std::vector<uint32_t> us;
+        uint64_t errors = 0;
+    };
+    std::mutex mu_;
+    std::map<std::string, Samples> routes_;
+
+public:
+    void record(const std::string& route, Clock::duration elapsed, bool ok) {
+        uint32_t us = (uint32_t)std::min<int64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count(), UINT32_MAX);
+        std::lock_guard<std::mutex> lock(mu_);
+        Samples& s = routes_[route];
+        if (ok) s.us.push_back(us);
+        else s.errors++;
+    }
+
+    json report(double seconds) {
+        std::lock_guard<std::mutex> lock(mu_);
+        json out = json::array();
+        for (auto& [route, s] : routes_) {
+            std::sort(s.us.begin(), s.us.end());
+            auto pct = [&](double p) {
+                if (s.us.empty()) return 0.0;
+                size_t i = std::min(s.us.size() - 1, (size_t)(p / 100.0 * s.us.size()));
+                return s.us[i] / 1000.0;
+            };
+            out.push_back({
+                {"route", route}, {"count", s.us.size()}, {"errors", s.errors},
+                {"rps", s.us.size() / seconds},
+                {"p50Ms", pct(50)}, {"p95Ms", pct(95)}, {"p99Ms", pct(99)}, {"p999Ms", pct(99.9)},
+                {"maxMs", s.us.empty() ? 0.0 : s.us.back() / 1000.0}
+            });
+        }
+        return out;
+    }
+};
+
+static RouteStats stats;
+static std::atomic<bool> stopping{false};
+
+// ── Virtual users ─────────────────────────────────────────
+struct VirtualUser {
+    std::string name, email, token;
+};
+
+static std::vector<VirtualUser> virtualUsers;
+
+httplib::Client makeClient(const Options& opt) {
+    httplib::Client cli(opt.host, opt.port);
+    cli.set_keep_alive(true);
+    cli.set_connection_timeout(5);
+    cli.set_read_timeout(70);   // longer than the server's long-poll cap
+    return cli;
+}
+
+httplib::Headers authHeaders(const VirtualUser& u) {
+    return {{"Authorization", "Bearer " + u.token}};
+}
+
+// Issues one request, records it under `route` and returns the parsed body
+// (null on failure, or for non-JSON responses)
+json timedGet(httplib::Client& cli, const std::string& route, const std::string& path,
+              const httplib::Headers& headers, bool parse = true) {
+    auto start = Clock::now();
+    auto res = cli.Get(path, headers);
+    bool ok = res && res->status < 400;
+    stats.record(route, Clock::now() - start, ok);
+    if (!ok || !parse) return nullptr;
+    json body = json::parse(res->body, nullptr, false);
+    return body.is_discarded() ? json(nullptr) : body;
+}
+
+json timedPost(httplib::Client& cli, const std::string& route, const std::string& path,
+               const httplib::Headers& headers, const json& payload) {
+    auto start = Clock::now();
+    auto res = cli.Post(path, headers, payload.dump(), "application/json");
+    bool ok = res && res->status < 400;
+    stats.record(route, Clock::now() - start, ok);
+    if (!ok) return nullptr;
+    json body = json::parse(res->body, nullptr, false);
+    return body.is_discarded() ? json(nullptr) : body;
+}
+
+bool login(httplib::Client& cli, VirtualUser& u) {
+    json body = timedPost(cli, "/api/auth/simple", "/api/auth/simple", {}, {{"username", u.name}});
+    if (!body.is_object() || !body.contains("token")) return false;
+    u.token = body["token"];
+    u.email = body["user"].value("email", u.name + "@local");
+    return true;
+}
+
+// Sleeps until `until`, waking early once the run is over
+void sleepUntil(Clock::time_point until) {
+    while (!stopping && Clock::now() < until)
+        std::this_thread::sleep_for(std::min<Clock::duration>(until - Clock::now(), std::chrono::milliseconds(100)));
+}
+
+// The live-update loop of one open browser tab (global chat)
+void pollLoop(const Options& opt, const VirtualUser& u, Clock::time_point end) {
+    httplib::Client cli = makeClient(opt);
+    auto headers = authHeaders(u);
+
+    json first = timedGet(cli, "/api/messages (page)", "/api/messages?chatType=global", headers);
+    uint64_t lastSeq = first.is_object() ? first.value("lastSeq", (uint64_t)0) : 0;
+
+    auto next = Clock::now();
+    int capDelayMs = 0;  // app.js doubles its retry while the server stays capped
+    while (!stopping && Clock::now() < end) {
+        std::string seq = std::to_string(lastSeq);
+        json body;
+        if (opt.longPoll) {
+            // Never park past the end of the run
+            auto left = std::chrono::duration_cast<std::chrono::seconds>(end - Clock::now()).count();
+            int timeout = (int)std::max<int64_t>(1, std::min<int64_t>(25, left));
+            body = timedGet(cli, "/api/messages/wait", "/api/messages/wait?chatType=global&afterSeq=" + seq +
+                            "&timeout=" + std::to_string(timeout), headers);
+            if (body.is_null()) sleepUntil(Clock::now() + std::chrono::seconds(3));  // app.js back-off
+            else if (body.value("retryAfterMs", 0) > 0) {  // server at its waiter cap
+                capDelayMs = capDelayMs ? std::min(capDelayMs * 2, 60000) : body.value("retryAfterMs", 0);
+                sleepUntil(Clock::now() + std::chrono::milliseconds(capDelayMs));
+            } else {
+                capDelayMs = 0;
+            }
+        } else {
+            next += std::chrono::milliseconds((int64_t)(opt.pollIntervalSec * 1000));
+            body = timedGet(cli, "/api/messages (poll)", "/api/messages?chatType=global&afterSeq=" + seq, headers);
+            sleepUntil(next);
+        }
+        if (body.is_object()) lastSeq = std::max(lastSeq, body.value("lastSeq", lastSeq));
+    }
+}
+
+// ── Scheduled actions (sends, user lists, exports) ────────
+enum class Action { Send, Users, Download };
+
+struct Event {
+    Clock::time_point due;
+    Action action;
+    size_t user;
+    bool operator>(const Event& o) const { return due > o.due; }
+};
+
+class Scheduler {
+    const Options& opt_;
+    Clock::time_point end_;
+    std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    std::mt19937_64 rng_{std::random_device{}()};
+    std::atomic<uint64_t> sendLagMs_{0};
+
+    Clock::duration exponential(double meanSec) {
+        std::exponential_distribution<double> d(1.0 / meanSec);
+        return std::chrono::microseconds((int64_t)(d(rng_) * 1e6));
+    }
+
+    void pushLocked(Clock::time_point due, Action action, size_t user) {
+        if (due < end_) events_.push({due, action, user});
+    }
+
+    void execute(httplib::Client& cli, const Event& ev, std::mt19937_64& rng) {
+        const VirtualUser& u = virtualUsers[ev.user];
+        auto headers = authHeaders(u);
+        switch (ev.action) {
+        case Action::Send: {
+            std::uniform_int_distribution<int> len(10, 200);
+            std::string text(len(rng), 'x');
+            for (auto& c : text) c = "abcdefghijklmnopqrstuvwxyz     "[rng() % 31];
+            json payload = {{"message", text}, {"chatType", "global"}, {"to", "global"}};
+            std::string route = "/api/send (global)";
+            if (virtualUsers.size() > 1 && std::uniform_real_distribution<double>(0, 1)(rng) < opt_.dmShare) {
+                size_t peer = (ev.user + 1 + rng() % (virtualUsers.size() - 1)) % virtualUsers.size();
+                payload["chatType"] = "private";
+                payload["to"] = virtualUsers[peer].email;
+                route = "/api/send (dm)";
+            }
+            timedPost(cli, route, "/api/send", headers, payload);
+            break;
+        }
+        case Action::Users:
+            timedGet(cli, "/api/users", "/api/users", headers, false);
+            break;
+        case Action::Download:
+            timedGet(cli, "/api/download", "/api/download?chatType=global&format=txt", headers, false);
+            break;
+        }
+    }
+
+public:
+    Scheduler(const Options& opt, Clock::time_point end) : opt_(opt), end_(end) {
+        auto now = Clock::now();
+        std::lock_guard<std::mutex> lock(mu_);
+        for (size_t i = 0; i < virtualUsers.size(); i++) {
+            pushLocked(now + std::chrono::milliseconds((int64_t)(opt.usersEverySec * 1000 * (i + 0.5) /
+                                                                 virtualUsers.size())), Action::Users, i);
+            pushLocked(now + exponential(opt.downloadEverySec), Action::Download, i);
+        }
+        if (opt.sendRate > 0) pushLocked(now + exponential(1.0 / opt.sendRate), Action::Send, 0);
+    }
+
+    // Worker: takes the next due event, schedules its successor (so the
+    // offered load does not depend on response times), then runs it
+    void work() {
+        httplib::Client cli = makeClient(opt_);
+        std::mt19937_64 rng{std::random_device{}()};
+        for (;;) {
+            Event ev;
+            {
+                std::unique_lock<std::mutex> lock(mu_);
+                for (;;) {
+                    if (stopping || events_.empty()) return;
+                    if (events_.top().due <= Clock::now()) break;
+                    cv_.wait_until(lock, std::min(events_.top().due, Clock::now() + std::chrono::milliseconds(100)));
+                }
+                ev = events_.top();
+                events_.pop();
+                switch (ev.action) {
+                case Action::Send: {
+                    pushLocked(ev.due + exponential(1.0 / opt_.sendRate), Action::Send, 0);
+                    ev.user = rng_() % virtualUsers.size();
+                    auto lag = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - ev.due).count();
+                    uint64_t prev = sendLagMs_.load();
+                    while ((uint64_t)lag > prev && !sendLagMs_.compare_exchange_weak(prev, lag)) {}
+                    break;
+                }
+                case Action::Users:
+                    pushLocked(ev.due + std::chrono::milliseconds((int64_t)(opt_.usersEverySec * 1000)),
+                               Action::Users, ev.user);
+                    break;
+                case Action::Download:
+                    pushLocked(ev.due + exponential(opt_.downloadEverySec), Action::Download, ev.user);
+                    break;
+                }
+            }
+            cv_.notify_one();
+            execute(cli, ev, rng);
+        }
+    }
+
+    void wake() { cv_.notify_all(); }
+
+    // Worst delay between a send falling due and a worker starting it;
+    // a large value means --workers, not the server, capped the send rate
+    uint64_t maxSendLagMs() const { return sendLagMs_.load(); }
+};
+
+// ── Report ────────────────────────────────────────────────
+void printTable(const json& routes, double seconds) {
+    char line[200];
+    snprintf(line, sizeof(line), "%-24s %8s %6s %9s %9s %9s %9s %9s %9s\n",
+             "route", "count", "errors", "req/s", "p50 ms", "p95 ms", "p99 ms", "p99.9 ms", "max ms");
+    std::cout << line;
+    for (auto& r : routes) {
+        snprintf(line, sizeof(line), "%-24s %8llu %6llu %9.1f %9.2f %9.2f %9.2f %9.2f %9.2f\n",
+                 r["route"].get<std::string>().c_str(), (unsigned long long)r["count"].get<uint64_t>(),
+                 (unsigned long long)r["errors"].get<uint64_t>(), r["rps"].get<double>(),
+                 r["p50Ms"].get<double>(), r["p95Ms"].get<double>(), r["p99Ms"].get<double>(),
+                 r["p999Ms"].get<double>(), r["maxMs"].get<double>());
+        std::cout << line;
+    }
+    std::cout << "(" << seconds << " s; /api/messages/wait latency includes time parked waiting for messages)"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) { std::cerr << "missing value for " << arg << std::endl; std::exit(2); }
+            return argv[++i];
+        };
+        if (arg == "--host") opt.host = value();
+        else if (arg == "--port") opt.port = std::stoi(value());
+        else if (arg == "--users") opt.users = std::max(1, std::stoi(value()));
+        else if (arg == "--duration") opt.durationSec = std::max(1.0, std::stod(value()));
+        else if (arg == "--send-rate") opt.sendRate = std::max(0.0, std::stod(value()));
+        else if (arg == "--dm-share") opt.dmShare = std::min(1.0, std::max(0.0, std::stod(value())));
+        else if (arg == "--poll") opt.longPoll = value() != "interval";
+        else if (arg == "--poll-interval") opt.pollIntervalSec = std::max(0.1, std::stod(value()));
+        else if (arg == "--users-every") opt.usersEverySec = std::max(0.1, std::stod(value()));
+        else if (arg == "--download-every") opt.downloadEverySec = std::max(0.1, std::stod(value()));
+        else if (arg == "--workers") opt.workers = std::max(1, std::stoi(value()));
+        else if (arg == "--prefix") opt.prefix = value();
+        else if (arg == "--json") opt.asJson = true;
+        else {
+            std::cerr << "usage: loadgen [--host h] [--port p] [--users n] [--duration s] [--send-rate msg/s]\n"
+                         "               [--dm-share f] [--poll long|interval] [--poll-interval s]\n"
+                         "               [--users-every s] [--download-every s] [--workers n] [--prefix p] [--json]"
+                      << std::endl;
+            return 2;
+        }
+    }
+
+    // ── Log everyone in ───────────────────────────────────
+    {
+        httplib::Client cli = makeClient(opt);
+        for (int i = 0; i < opt.users; i++) {
+            VirtualUser u;
+            u.name = opt.prefix + "_" + std::to_string(i);
+            if (!login(cli, u)) {
+                std::cerr << "❌ Login failed for " << u.name << " — is a local-mode server on "
+                          << opt.host << ":" << opt.port << "?" << std::endl;
+                return 1;
+            }
+            virtualUsers.push_back(u);
+        }
+    }
+    if (!opt.asJson)
+        std::cout << "👥 " << opt.users << " users logged in; running for " << opt.durationSec << " s" << std::endl;
+
+    // ── Run ───────────────────────────────────────────────
+    auto start = Clock::now();
+    auto end = start + std::chrono::milliseconds((int64_t)(opt.durationSec * 1000));
+    Scheduler scheduler(opt, end);
+    std::vector<std::thread> threads;
+    for (auto& u : virtualUsers) threads.emplace_back([&opt, &u, end] { pollLoop(opt, u, end); });
+    for (int i = 0; i < opt.workers; i++) threads.emplace_back([&scheduler] { scheduler.work(); });
+
+    sleepUntil(end);
+    stopping = true;
+    scheduler.wake();
+    for (auto& t : threads) t.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    json routes = stats.report(seconds);
+    if (opt.asJson) {
+        std::cout << json({
+            {"config", {{"users", opt.users}, {"durationSec", opt.durationSec}, {"sendRate", opt.sendRate},
+                        {"dmShare", opt.dmShare}, {"poll", opt.longPoll ? "long" : "interval"},
+                        {"workers", opt.workers}}},
+            {"seconds", seconds}, {"maxSendLagMs", scheduler.maxSendLagMs()}, {"routes", routes}
+        }).dump(2) << std::endl;
+    } else {
+        printTable(routes, seconds);
+        if (scheduler.maxSendLagMs() > 1000)
+            std::cout << "⚠️  Sends fell up to " << scheduler.maxSendLagMs()
+                      << " ms behind schedule; raise --workers" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+// ═══════════════════════════════════════════════════════════
+//  LRU Cache — byte-budgeted, thread-safe
+//  Evicts least-recently-used entries once the summed entry
+//  cost exceeds the budget; counts hits and misses for sizing
+// ═══════════════════════════════════════════════════════════
+
+template<typename K, typename V>
+class LruCache {
+private:
+    using Entry = std::pair<K, V>;
+    using CostFn = std::function<size_t(const K&, const V&)>;
+
+    std::list<Entry> order_;    // front = most recently used
+    std::unordered_map<K, typename std::list<Entry>::iterator> index_;
+    size_t budget_;
+    size_t used_ = 0;
+    CostFn cost_;
+    mutable std::mutex mu_;
+    std::atomic<uint64_t> hits_{0}, misses_{0}, evictions_{0};
+
+    void evictLocked() {
+        while (used_ > budget_ && !order_.empty()) {
+            auto& last = order_.back();
+            used_ -= cost_(last.first, last.second);
+            index_.erase(last.first);
+            order_.pop_back();
+            evictions_++;
+        }
+    }
+
+public:
+    LruCache(size_t budgetBytes, CostFn cost) : budget_(budgetBytes), cost_(std::move(cost)) {}
+
+    // Copies the cached value into `out` and marks it most recently used
+    bool get(const K& key, V& out) {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = index_.find(key);
+        if (it == index_.end()) { misses_++; return false; }
+        order_.splice(order_.begin(), order_, it->second);
+        out = it->second->second;
+        hits_++;
+        return true;
+    }
+
+    void put(const K& key, const V& value) {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            used_ -= cost_(it->second->first, it->second->second);
+            order_.erase(it->second);
+            index_.erase(it);
+        }
+        order_.emplace_front(key, value);
+        index_[key] = order_.begin();
+        used_ += cost_(key, value);
+        evictLocked();
+    }
+
+    // Drops every entry matching `pred`; O(n), meant for rare invalidations
+    template<typename Pred>
+    size_t eraseIf(Pred pred) {
+        std::lock_guard<std::mutex> lock(mu_);
+        size_t erased = 0;
+        for (auto it = order_.begin(); it != order_.end();) {
+            if (pred(it->first, it->second)) {
+                used_ -= cost_(it->first, it->second);
+                index_.erase(it->first);
+                it = order_.erase(it);
+                erased++;
+            } else {
+                ++it;
+            }
+        }
+        return erased;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mu_);
+        order_.clear();
+        index_.clear();
+        used_ = 0;
+    }
+
+    // ── Accessors ─────────────────────────────────────────
+    size_t size() const { std::lock_guard<std::mutex> lock(mu_); return order_.size(); }
+    size_t bytesUsed() const { std::lock_guard<std::mutex> lock(mu_); return used_; }
+    size_t budget() const { return budget_; }
+    uint64_t hits() const { return hits_.load(); }
+    uint64_t misses() const { return misses_.load(); }
+    uint64_t evictions() const { return evictions_.load(); }
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "json.hpp"
+#include "trace.hpp"
+
+using json = nlohmann::json;
+
+// ═══════════════════════════════════════════════════════════
+//  Message — chat record and its wire (JSON) form
+// ═══════════════════════════════════════════════════════════
+
+struct Message {
+    std::string id;
+    std::string from;
+    std::string fromName;
+    std::string fromAvatar;
+    std::string to;
+    std::string toName;
+    std::string content;        // encrypted in DB, plain in memory
+    std::string chatType;       // "global" or "private"
+    int64_t timestamp;
+    uint64_t seq = 0;           // server-wide order; 0 = not yet assigned
+    // Serialized toJson(), built once by seal() and shared by every copy.
+    // Fields must not change after sealing.
+    std::shared_ptr<const std::string> fragment = nullptr;
+
+    json toJson() const {
+        return {
+            {"_id", id}, {"from", from}, {"fromName", fromName},
+            {"fromAvatar", fromAvatar}, {"to", to}, {"toName", toName},
+            {"content", content}, {"chatType", chatType}, {"timestamp", timestamp},
+            {"seq", seq}
+        };
+    }
+
+    // Call once a message is created or loaded, before it is shared
+    void seal() { fragment = std::make_shared<const std::string>(toJson().dump()); }
+
+    void appendJson(std::string& out) const {
+        if (fragment) out += *fragment;
+        else out += toJson().dump();
+    }
+};
+
+// `[m1,m2,...]` from sealed fragments: one reservation, then plain copies
+inline void appendMessageArray(std::string& out, const std::vector<Message>& msgs) {
+    TracePhase phase("json");
+    size_t bytes = 2 + msgs.size();
+    for (auto& m : msgs) bytes += m.fragment ? m.fragment->size() : 256;
+    out.reserve(out.size() + bytes);
+    out += '[';
+    for (size_t i = 0; i < msgs.size(); i++) {
+        if (i) out += ',';
+        msgs[i].appendJson(out);
+    }
+    out += ']';
+}
@@ -0,0 +1,368 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// ═══════════════════════════════════════════════════════════
+//  Segmented Append-Only Log — durable storage for local mode
+//  Fixed-size segments · checksummed binary records · mmap replay
+// ═══════════════════════════════════════════════════════════
+//
+//  Segments:  <dir>/seg_000001.log, seg_000002.log, ...
+//  Record:    u32 magic | u32 bodyLen | u32 FNV-1a(body) | body
+//  Integers are stored in host byte order (little-endian on every
+//  platform we build for). The body layout belongs to the caller.
+//
+//  write() hands a record to the OS and returns its log sequence number;
+//  sync(lsn) returns once that record is on disk. fsync runs outside the
+//  append lock and one call covers every record written before it (group
+//  commit), so concurrent writers share a flush instead of queueing on the
+//  disk. append() is write() + sync(). With `sync` off, a record survives
+//  a process crash but not a power loss. A failed write is cut back off
+//  its segment, so later records never land behind a torn one.
+
+// ── Record Encoding ───────────────────────────────────────
+class RecordWriter {
+private:
+    std::string buf_;
+
+public:
+    void u8(uint8_t v) { buf_.push_back((char)v); }
+    void i64(int64_t v) { buf_.append((const char*)&v, sizeof(v)); }
+    void str(const std::string& s) {
+        uint32_t n = (uint32_t)s.size();
+        buf_.append((const char*)&n, sizeof(n));
+        buf_.append(s);
+    }
+    const std::string& data() const { return buf_; }
+};
+
+class RecordReader {
+private:
+    const char* p_;
+    const char* end_;
+    bool ok_ = true;
+
+    bool take(void* out, size_t n) {
+        if (!ok_ || (size_t)(end_ - p_) < n) { ok_ = false; return false; }
+        memcpy(out, p_, n);
+        p_ += n;
+        return true;
+    }
+
+public:
+    RecordReader(const char* data, size_t size) : p_(data), end_(data + size) {}
+
+    uint8_t u8() { uint8_t v = 0; take(&v, sizeof(v)); return v; }
+    int64_t i64() { int64_t v = 0; take(&v, sizeof(v)); return v; }
+    std::string str() {
+        uint32_t n = 0;
+        if (!take(&n, sizeof(n)) || (size_t)(end_ - p_) < n) { ok_ = false; return {}; }
+        std::string s(p_, n);
+        p_ += n;
+        return s;
+    }
+    bool ok() const { return ok_; }
+};
+
+// ── Read-only memory mapping ──────────────────────────────
+class MappedFile {
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = NULL;
+#endif
+
+public:
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file_ == INVALID_HANDLE_VALUE) return;
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(file_, &sz) || sz.QuadPart == 0) return;
+        mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping_) return;
+        data_ = (const char*)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+        if (data_) size_ = (size_t)sz.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data_ = (const char*)p;
+                size_ = st.st_size;
+                madvise(p, size_, MADV_SEQUENTIAL);
+            }
+        }
+        ::close(fd);  // the mapping stays valid
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+#else
+        if (data_) munmap((void*)data_, size_);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+};
+
+// ── Segmented Log ─────────────────────────────────────────
+class SegmentedLog {
+private:
+    static const uint32_t MAGIC = 0x474F4C43;  // "CLOG"
+    static const size_t HEADER = 12;
+
+    std::string dir_;
+    size_t segmentBytes_;
+    bool sync_;
+    std::mutex mu_;
+    std::FILE* out_ = nullptr;
+    uint32_t segIndex_ = 0;
+    size_t segSize_ = 0;
+    size_t segments_ = 0;
+    uint64_t records_ = 0;
+    uint64_t written_ = 0;                // lsn of the newest write, under mu_
+
+    // Group commit state, under syncMu_ (never taken inside mu_)
+    std::mutex syncMu_;
+    std::condition_variable synced_;
+    bool syncing_ = false;
+    uint64_t syncedLsn_ = 0;
+    std::atomic<uint64_t> failedLsn_{0};  // records up to here may not be on disk
+
+    static uint32_t checksum(const char* p, size_t n) {
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < n; i++) h = (h ^ (uint8_t)p[i]) * 16777619u;
+        return h;
+    }
+
+    std::string segmentPath(uint32_t idx) const {
+        char name[32];
+        snprintf(name, sizeof(name), "seg_%06u.log", idx);
+        return (std::filesystem::path(dir_) / name).string();
+    }
+
+    std::vector<uint32_t> listSegments() const {
+        std::vector<uint32_t> out;
+        std::error_code ec;
+        for (auto& entry : std::filesystem::directory_iterator(dir_, ec)) {
+            unsigned idx = 0;
+            std::string name = entry.path().filename().string();
+            if (sscanf(name.c_str(), "seg_%6u.log", &idx) == 1) out.push_back(idx);
+        }
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+    static bool syncFile(std::FILE* f) {
+#ifdef _WIN32
+        return _commit(_fileno(f)) == 0;
+#else
+        return fsync(fileno(f)) == 0;
+#endif
+    }
+
+    // fsyncs the current segment through its own descriptor, so the append
+    // lock is held only to duplicate it
+    bool syncCurrent(uint64_t& lsn) {
+        int fd;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            lsn = written_;
+            if (!out_) return false;
+#ifdef _WIN32
+            fd = _dup(_fileno(out_));
+#else
+            fd = dup(fileno(out_));
+#endif
+        }
+        if (fd < 0) return false;
+#ifdef _WIN32
+        bool ok = _commit(fd) == 0;
+        _close(fd);
+#else
+        bool ok = fsync(fd) == 0;
+        ::close(fd);
+#endif
+        return ok;
+    }
+
+    // A new segment's directory entry must reach the disk too (POSIX)
+    void syncDir() const {
+#ifndef _WIN32
+        int fd = ::open(dir_.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            fsync(fd);
+            ::close(fd);
+        }
+#endif
+    }
+
+    bool openSegment(uint32_t idx) {
+        // Records left in the outgoing segment are not covered by later syncs
+        if (out_ && sync_ && !syncFile(out_)) failedLsn_ = written_;
+        if (out_) std::fclose(out_);
+        std::error_code ec;
+        bool created = !std::filesystem::exists(segmentPath(idx), ec);
+        out_ = std::fopen(segmentPath(idx).c_str(), "ab");
+        segIndex_ = idx;
+        auto sz = std::filesystem::file_size(segmentPath(idx), ec);
+        segSize_ = ec ? 0 : (size_t)sz;
+        if (out_ && created && sync_) syncDir();
+        return out_ != nullptr;
+    }
+
+    // Drops whatever part of a failed append reached the file. If the
+    // segment cannot be cut back, appends move on to a fresh segment and
+    // replay discards only the torn tail of this one.
+    void rollbackLocked() {
+        std::fclose(out_);  // flushes any buffered remainder before the cut
+        out_ = nullptr;
+        std::error_code ec;
+        std::filesystem::resize_file(segmentPath(segIndex_), segSize_, ec);
+        if (!ec && openSegment(segIndex_)) return;
+        if (sync_) failedLsn_ = written_;  // earlier, unsynced records stay behind
+        if (openSegment(segIndex_ + 1)) segments_++;
+    }
+
+    // Hands each valid record body to fn; returns the end of the valid prefix
+    static size_t scan(const char* data, size_t size, const std::function<void(const char*, size_t)>& fn) {
+        size_t off = 0;
+        while (size - off >= HEADER) {
+            uint32_t magic, len, sum;
+            memcpy(&magic, data + off, 4);
+            memcpy(&len, data + off + 4, 4);
+            memcpy(&sum, data + off + 8, 4);
+            if (magic != MAGIC || size - off - HEADER < len) break;
+            const char* body = data + off + HEADER;
+            if (checksum(body, len) != sum) break;
+            fn(body, len);
+            off += HEADER + len;
+        }
+        return off;
+    }
+
+public:
+    SegmentedLog(std::string dir, size_t segmentBytes, bool sync = true)
+        : dir_(std::move(dir)), segmentBytes_(segmentBytes), sync_(sync) {}
+
+    ~SegmentedLog() { if (out_) std::fclose(out_); }
+
+    // Maps every segment and replays its records oldest-first, then opens
+    // the newest segment for appends. A torn record left by a crash
+    // mid-append is truncated away along with the rest of its segment.
+    bool open(const std::function<void(const char*, size_t)>& fn) {
+        std::lock_guard<std::mutex> lock(mu_);
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+
+        auto segs = listSegments();
+        for (size_t i = 0; i < segs.size(); i++) {
+            size_t valid, total;
+            {
+                MappedFile file(segmentPath(segs[i]));
+                total = file.size();
+                valid = file.data() ? scan(file.data(), total, [&](const char* p, size_t n) {
+                    records_++;
+                    fn(p, n);
+                }) : 0;
+            }
+            // Drop the torn tail so later appends stay reachable
+            if (valid < total) std::filesystem::resize_file(segmentPath(segs[i]), valid, ec);
+        }
+        segments_ = std::max<size_t>(segs.size(), 1);
+        return openSegment(segs.empty() ? 1 : segs.back());
+    }
+
+    // Writes `rec` through to the OS without waiting for the disk; returns
+    // its lsn for sync(), or 0 if the write failed and was rolled back
+    uint64_t write(const RecordWriter& rec) {
+        const std::string& body = rec.data();
+        uint32_t header[3] = {MAGIC, (uint32_t)body.size(), checksum(body.data(), body.size())};
+        std::lock_guard<std::mutex> lock(mu_);
+        if (!out_) return 0;
+        if (segSize_ > 0 && segSize_ + HEADER + body.size() > segmentBytes_) {
+            if (!openSegment(segIndex_ + 1)) return 0;
+            segments_++;
+        }
+        bool ok = std::fwrite(header, 1, HEADER, out_) == HEADER &&
+                  std::fwrite(body.data(), 1, body.size(), out_) == body.size() &&
+                  std::fflush(out_) == 0;
+        if (!ok) {
+            rollbackLocked();
+            return 0;
+        }
+        segSize_ += HEADER + body.size();
+        records_++;
+        return ++written_;
+    }
+
+    // Returns once every record up to `lsn` is on disk. The first caller
+    // to find no flush in progress runs one for all records written so
+    // far; the others wait for it. False if a flush covering `lsn` failed.
+    bool sync(uint64_t lsn) {
+        if (!sync_) return true;
+        std::unique_lock<std::mutex> lock(syncMu_);
+        while (syncedLsn_ < lsn && lsn > failedLsn_) {
+            if (syncing_) {
+                synced_.wait(lock);
+                continue;
+            }
+            syncing_ = true;
+            lock.unlock();
+            uint64_t covered;
+            bool ok = syncCurrent(covered);
+            lock.lock();
+            syncing_ = false;
+            if (ok) syncedLsn_ = std::max(syncedLsn_, covered);
+            else failedLsn_ = std::max(failedLsn_.load(), covered);
+            synced_.notify_all();
+        }
+        return lsn > failedLsn_;
+    }
+
+    bool append(const RecordWriter& rec) {
+        uint64_t lsn = write(rec);
+        return lsn != 0 && sync(lsn);
+    }
+
+    // ── Accessors ─────────────────────────────────────────
+    size_t segments() { std::lock_guard<std::mutex> lock(mu_); return segments_; }
+    uint64_t records() { std::lock_guard<std::mutex> lock(mu_); return records_; }
+    const std::string& dir() const { return dir_; }
+};
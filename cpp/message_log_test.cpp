@@ -0,0 +1,198 @@
+// ═══════════════════════════════════════════════════════════
+//  ChatApp Logger — Segmented log recovery test
+// ═══════════════════════════════════════════════════════════
+//
+//  ./message_log_test           exit code 0 = pass
+//
+//  Simulates a crash in the middle of an append (a record header
+//  with only part of its body on disk) and checks that reopening
+//  replays every complete record, cuts the torn tail off, and
+//  that records appended afterwards survive the next reopen; that an
+//  append failing part-way leaves no torn bytes behind; and that
+//  concurrent synced appends sharing fsyncs all reach the log.
+
+#include "message_log.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#ifndef _WIN32
+#include <csignal>
+#include <sys/resource.h>
+#endif
+
+static int failures = 0;
+
+#define CHECK(cond)                                                              \
+    do {                                                                         \
+        if (!(cond)) {                                                           \
+            std::cerr << "FAIL " << __FILE__ << ":" << __LINE__ << "  " #cond << std::endl; \
+            failures++;                                                          \
+        }                                                                        \
+    } while (0)
+
+namespace fs = std::filesystem;
+
+RecordWriter record(const std::string& text) {
+    RecordWriter rec;
+    rec.str(text);
+    return rec;
+}
+
+// Opens the log at `dir` and returns the replayed records in order
+std::vector<std::string> replay(SegmentedLog& log) {
+    std::vector<std::string> out;
+    CHECK(log.open([&](const char* p, size_t n) {
+        RecordReader r(p, n);
+        out.push_back(r.str());
+        CHECK(r.ok());
+    }));
+    return out;
+}
+
+void testTornTail(const fs::path& dir) {
+    {
+        SegmentedLog log(dir.string(), 1 << 20);
+        CHECK(replay(log).empty());
+        for (auto* text : {"first", "second", "third"}) CHECK(log.append(record(text)));
+    }
+    fs::path seg = dir / "seg_000001.log";
+    auto goodSize = fs::file_size(seg);
+
+    // Crash mid-append: a full header announcing 64 body bytes, then 10
+    {
+        std::ofstream torn(seg, std::ios::binary | std::ios::app);
+        uint32_t header[3] = {0x474F4C43, 64, 0};
+        torn.write((const char*)header, sizeof(header));
+        torn.write("0123456789", 10);
+    }
+    CHECK(fs::file_size(seg) == goodSize + 22);
+
+    {
+        SegmentedLog log(dir.string(), 1 << 20);
+        std::vector<std::string> got = replay(log);
+        CHECK((got == std::vector<std::string>{"first", "second", "third"}));
+        CHECK(log.records() == 3);
+        CHECK(fs::file_size(seg) == goodSize);  // torn bytes cut off
+        CHECK(log.append(record("fourth")));
+    }
+
+    // The record appended after recovery must be reachable
+    {
+        SegmentedLog log(dir.string(), 1 << 20);
+        std::vector<std::string> got = replay(log);
+        CHECK((got == std::vector<std::string>{"first", "second", "third", "fourth"}));
+    }
+}
+
+void testCorruptRecord(const fs::path& dir) {
+    {
+        SegmentedLog log(dir.string(), 1 << 20);
+        replay(log);
+        for (auto* text : {"alpha", "bravo", "charlie"}) CHECK(log.append(record(text)));
+    }
+    // Flip a byte inside the second record's body; the checksum rejects it
+    // and everything after it in the segment
+    fs::path seg = dir / "seg_000001.log";
+    {
+        std::fstream f(seg, std::ios::binary | std::ios::in | std::ios::out);
+        f.seekp(12 + 4 + 5 + 12 + 4);  // header + len + "alpha", header + len
+        f.put('X');
+    }
+    SegmentedLog log(dir.string(), 1 << 20);
+    CHECK((replay(log) == std::vector<std::string>{"alpha"}));
+}
+
+void testSegmentRoll(const fs::path& dir) {
+    {
+        SegmentedLog log(dir.string(), 24, false);  // every record starts a new segment
+        replay(log);
+        for (auto* text : {"one", "two", "three"}) CHECK(log.append(record(text)));
+        CHECK(log.segments() == 3);
+    }
+    SegmentedLog log(dir.string(), 24, false);
+    CHECK((replay(log) == std::vector<std::string>{"one", "two", "three"}));
+}
+
+// Writers sync concurrently, so most of their fsyncs are shared; every
+// acknowledged record must still be there after a reopen
+void testGroupCommit(const fs::path& dir) {
+    const int THREADS = 8, PER_THREAD = 50;
+    std::atomic<int> acked{0};
+    {
+        SegmentedLog log(dir.string(), 4096);  // rolls segments mid-run too
+        replay(log);
+        std::vector<std::thread> writers;
+        for (int t = 0; t < THREADS; t++) {
+            writers.emplace_back([&, t] {
+                for (int i = 0; i < PER_THREAD; i++) {
+                    uint64_t lsn = log.write(record(std::to_string(t) + ":" + std::to_string(i)));
+                    if (lsn && log.sync(lsn)) acked++;
+                }
+            });
+        }
+        for (auto& w : writers) w.join();
+    }
+    CHECK(acked == THREADS * PER_THREAD);
+    SegmentedLog log(dir.string(), 4096);
+    std::vector<std::string> got = replay(log);
+    CHECK((int)got.size() == THREADS * PER_THREAD);
+    // Each writer's records keep their order
+    std::vector<int> next(THREADS, 0);
+    for (auto& r : got) {
+        int t = std::stoi(r.substr(0, r.find(':'))), i = std::stoi(r.substr(r.find(':') + 1));
+        CHECK(i == next[t]);
+        next[t] = i + 1;
+    }
+}
+
+#ifndef _WIN32
+// A write that fails part-way (file size limit hit mid-record) must leave
+// the segment exactly as it was, and the next append must be replayable
+void testFailedAppend(const fs::path& dir) {
+    std::signal(SIGXFSZ, SIG_IGN);  // get EFBIG instead of being killed
+    SegmentedLog log(dir.string(), 1 << 20, false);
+    replay(log);
+    CHECK(log.append(record("kept")));
+    fs::path seg = dir / "seg_000001.log";
+    auto goodSize = fs::file_size(seg);
+
+    rlimit old;
+    getrlimit(RLIMIT_FSIZE, &old);
+    rlimit small = old;
+    small.rlim_cur = goodSize + 100;
+    setrlimit(RLIMIT_FSIZE, &small);
+    CHECK(!log.append(record(std::string(4096, 'x'))));
+    setrlimit(RLIMIT_FSIZE, &old);
+
+    CHECK(fs::file_size(seg) == goodSize);
+    CHECK(log.records() == 1);
+    CHECK(log.append(record("after")));
+
+    SegmentedLog reopened(dir.string(), 1 << 20, false);
+    CHECK((replay(reopened) == std::vector<std::string>{"kept", "after"}));
+}
+#endif
+
+int main() {
+    fs::path root = fs::temp_directory_path() /
+        ("message_log_test_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+    struct Case { const char* name; void (*fn)(const fs::path&); };
+    for (Case c : {Case{"torn tail", testTornTail}, Case{"corrupt record", testCorruptRecord},
+                   Case{"segment roll", testSegmentRoll}, Case{"group commit", testGroupCommit},
+#ifndef _WIN32
+                   Case{"failed append", testFailedAppend},
+#endif
+                  }) {
+        int before = failures;
+        c.fn(root / c.name);
+        std::cout << (failures == before ? "ok   " : "FAIL ") << c.name << std::endl;
+    }
+    std::error_code ec;
+    fs::remove_all(root, ec);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,255 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <stdexcept>
+#include <cstdio>
+#include <cstdint>
+
+// ═══════════════════════════════════════════════════════════
+//  Metrics — counters, gauges and latency histograms
+//  Each thread records into its own shard of relaxed atomics
+//  (no locked instructions, no shared cache lines); a scrape
+//  sums the shards into Prometheus text exposition format.
+// ═══════════════════════════════════════════════════════════
+//
+//  Series are registered up front and addressed by slot, so a
+//  recording is one thread_local lookup plus a load and a store.
+
+class Metrics {
+public:
+    struct Counter { uint32_t slot = 0; };      // also used for summed gauges
+    struct Histogram {
+        uint32_t slot = 0;                      // buckets..., +Inf, sum (ns)
+        const std::vector<uint64_t>* boundsNs = nullptr;
+    };
+
+private:
+    enum class Kind { Counter, Gauge, Histogram, GaugeFn, CounterFn };
+
+    struct Family {
+        std::string name, help;
+        Kind kind;
+    };
+
+    struct Series {
+        size_t family;
+        std::string labels;                     // `a="x",b="y"` (already escaped)
+        uint32_t slot;
+        std::vector<uint64_t> boundsNs;
+        std::function<double()> fn;
+    };
+
+    using Shard = std::unique_ptr<std::atomic<uint64_t>[]>;
+
+    const size_t capacity_;
+    mutable std::mutex mu_;
+    std::vector<Family> families_;
+    std::deque<Series> series_;                 // deque: Histogram keeps a pointer into it
+    uint32_t used_ = 0;
+    std::vector<Shard> shards_;                 // never freed, so exited threads still count
+    std::unordered_map<std::thread::id, std::atomic<uint64_t>*> byThread_;
+
+    size_t familyLocked(const std::string& name, const std::string& help, Kind kind) {
+        for (size_t i = 0; i < families_.size(); i++)
+            if (families_[i].name == name) return i;
+        families_.push_back({name, help, kind});
+        return families_.size() - 1;
+    }
+
+    uint32_t reserveLocked(uint32_t n) {
+        if (used_ + n > capacity_) throw std::length_error("Metrics: slot capacity exhausted");
+        uint32_t slot = used_;
+        used_ += n;
+        return slot;
+    }
+
+    std::atomic<uint64_t>* shardSlow() {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto& shard = byThread_[std::this_thread::get_id()];
+        if (!shard) {
+            shards_.emplace_back(new std::atomic<uint64_t>[capacity_]());
+            shard = shards_.back().get();
+        }
+        return shard;
+    }
+
+    std::atomic<uint64_t>* shard() {
+        thread_local const Metrics* owner = nullptr;
+        thread_local std::atomic<uint64_t>* cached = nullptr;
+        if (owner != this) {
+            cached = shardSlow();
+            owner = this;
+        }
+        return cached;
+    }
+
+    // Written only by the owning thread, so no read-modify-write is needed
+    static void bump(std::atomic<uint64_t>& v, uint64_t n) {
+        v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    uint64_t sumLocked(uint32_t slot) const {
+        uint64_t total = 0;
+        for (auto& s : shards_) total += s[slot].load(std::memory_order_relaxed);
+        return total;
+    }
+
+    static std::string number(double v) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.15g", v);
+        return buf;
+    }
+
+public:
+    explicit Metrics(size_t capacity = 1024) : capacity_(capacity) {}
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    // ── Registration (startup) ────────────────────────────
+    Counter counter(const std::string& name, const std::string& help, const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mu_);
+        size_t family = familyLocked(name, help, Kind::Counter);
+        uint32_t slot = reserveLocked(1);
+        series_.push_back({family, labels, slot, {}, nullptr});
+        return {slot};
+    }
+
+    // A gauge moved with add()/sub(), e.g. requests in flight
+    Counter gauge(const std::string& name, const std::string& help, const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mu_);
+        size_t family = familyLocked(name, help, Kind::Gauge);
+        uint32_t slot = reserveLocked(1);
+        series_.push_back({family, labels, slot, {}, nullptr});
+        return {slot};
+    }
+
+    // A gauge read from existing state at scrape time
+    void gaugeFn(const std::string& name, const std::string& help, std::function<double()> fn,
+                 const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mu_);
+        size_t family = familyLocked(name, help, Kind::GaugeFn);
+        series_.push_back({family, labels, 0, {}, std::move(fn)});
+    }
+
+    // A counter kept elsewhere (e.g. cache hits), read at scrape time
+    void counterFn(const std::string& name, const std::string& help, std::function<double()> fn,
+                   const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mu_);
+        size_t family = familyLocked(name, help, Kind::CounterFn);
+        series_.push_back({family, labels, 0, {}, std::move(fn)});
+    }
+
+    // Latency histogram; `bounds` are bucket upper limits in seconds
+    Histogram histogram(const std::string& name, const std::string& help, const std::vector<double>& bounds,
+                        const std::string& labels = "") {
+        std::lock_guard<std::mutex> lock(mu_);
+        size_t family = familyLocked(name, help, Kind::Histogram);
+        uint32_t slot = reserveLocked((uint32_t)bounds.size() + 2);
+        std::vector<uint64_t> ns;
+        for (double b : bounds) ns.push_back((uint64_t)(b * 1e9));
+        series_.push_back({family, labels, slot, std::move(ns), nullptr});
+        return {slot, &series_.back().boundsNs};
+    }
+
+    // ── Recording (hot path) ──────────────────────────────
+    void add(Counter c, uint64_t n = 1) { bump(shard()[c.slot], n); }
+    void sub(Counter c, uint64_t n = 1) { bump(shard()[c.slot], (uint64_t)0 - n); }  // wraps; summed mod 2^64
+
+    void observeNs(Histogram h, uint64_t ns) {
+        std::atomic<uint64_t>* s = shard();
+        const std::vector<uint64_t>& bounds = *h.boundsNs;
+        size_t b = 0;
+        while (b < bounds.size() && ns > bounds[b]) b++;
+        bump(s[h.slot + b], 1);
+        bump(s[h.slot + bounds.size() + 1], ns);
+    }
+
+    void observe(Histogram h, std::chrono::steady_clock::duration d) {
+        observeNs(h, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    }
+
+    // Observes the lifetime of the scope it is declared in
+    class Timer {
+        Metrics& m_;
+        Histogram h_;
+        std::chrono::steady_clock::time_point start_;
+
+    public:
+        Timer(Metrics& m, Histogram h) : m_(m), h_(h), start_(std::chrono::steady_clock::now()) {}
+        ~Timer() { m_.observe(h_, std::chrono::steady_clock::now() - start_); }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+    };
+
+    // ── Exposition ────────────────────────────────────────
+    std::string render() const {
+        std::lock_guard<std::mutex> lock(mu_);
+        std::string out;
+        out.reserve(series_.size() * 96);
+        auto sample = [&](const std::string& name, const std::string& labels, const std::string& value) {
+            out += name;
+            if (!labels.empty()) out += "{" + labels + "}";
+            out += ' ';
+            out += value;
+            out += '\n';
+        };
+        for (size_t f = 0; f < families_.size(); f++) {
+            const Family& fam = families_[f];
+            const char* type = fam.kind == Kind::Counter || fam.kind == Kind::CounterFn ? "counter"
+                             : fam.kind == Kind::Histogram ? "histogram" : "gauge";
+            out += "# HELP " + fam.name + " " + fam.help + "\n";
+            out += "# TYPE " + fam.name + " " + type + "\n";
+            for (auto& s : series_) {
+                if (s.family != f) continue;
+                switch (fam.kind) {
+                case Kind::Counter:
+                    sample(fam.name, s.labels, std::to_string(sumLocked(s.slot)));
+                    break;
+                case Kind::Gauge:
+                    sample(fam.name, s.labels, std::to_string((int64_t)sumLocked(s.slot)));
+                    break;
+                case Kind::GaugeFn:
+                case Kind::CounterFn:
+                    sample(fam.name, s.labels, number(s.fn()));
+                    break;
+                case Kind::Histogram: {
+                    std::string sep = s.labels.empty() ? "" : s.labels + ",";
+                    uint64_t cumulative = 0;
+                    for (size_t b = 0; b <= s.boundsNs.size(); b++) {
+                        cumulative += sumLocked(s.slot + (uint32_t)b);
+                        std::string le = b < s.boundsNs.size() ? number(s.boundsNs[b] / 1e9) : "+Inf";
+                        sample(fam.name + "_bucket", sep + "le=\"" + le + "\"", std::to_string(cumulative));
+                    }
+                    uint64_t sumNs = sumLocked(s.slot + (uint32_t)s.boundsNs.size() + 1);
+                    sample(fam.name + "_sum", s.labels, number(sumNs / 1e9));
+                    sample(fam.name + "_count", s.labels, std::to_string(cumulative));
+                    break;
+                }
+                }
+            }
+        }
+        return out;
+    }
+};
+
+// ── Process-wide registry ─────────────────────────────────
+// Shared by every module that records; inline variables are initialised
+// before anything defined after this header, so statics may register here.
+inline Metrics metrics;
+inline const std::vector<double> LATENCY_BUCKETS = {
+    0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+    0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 10, 60
+};
+
+inline Metrics::Histogram latencyMetric(const char* name, const char* help, const std::string& labels = "") {
+    return metrics.histogram(name, help, LATENCY_BUCKETS, labels);
+}
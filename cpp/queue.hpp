@@ -3,6 +3,9 @@
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <cstdint>
 
 // ═══════════════════════════════════════════════════════════
 //  FIFO Queue Data Structure — Core DSA Component
@@ -69,3 +72,77 @@ public:
     auto begin() const { return data_.begin(); }
     auto end() const { return data_.end(); }
 };
+
+// ═══════════════════════════════════════════════════════════
+//  Ring Queue — fixed-capacity FIFO that overwrites the oldest
+//  Per-slot atomic shared_ptr swaps; no queue-wide lock
+// ═══════════════════════════════════════════════════════════
+//
+//  Not lock-free: std::atomic_load / compare_exchange on shared_ptr
+//  take a short lock from the standard library's internal mutex
+//  pool, and every enqueue allocates one node. Producers and
+//  readers only contend when they touch the same slot.
+
+template<typename T>
+class RingQueue {
+private:
+    // Each slot holds an immutable node tagged with its sequence number,
+    // so readers can tell a current entry from one that was lapped.
+    struct Node {
+        uint64_t seq;
+        T value;
+    };
+
+    std::vector<std::shared_ptr<const Node>> slots_;  // only via std::atomic_load/CAS
+    std::atomic<uint64_t> head_{0};                   // next sequence to claim
+    std::atomic<uint64_t> floor_{0};                  // sequences below were cleared
+    size_t capacity_;
+
+public:
+    explicit RingQueue(size_t capacity = 10)
+        : slots_(std::max<size_t>(capacity, 1)), capacity_(std::max<size_t>(capacity, 1)) {}
+
+    // ── Core Operations ───────────────────────────────────
+    void enqueue(const T& item) {
+        uint64_t seq = head_.fetch_add(1);
+        auto node = std::make_shared<const Node>(Node{seq, item});
+        auto& slot = slots_[seq % capacity_];
+        // A delayed producer must not clobber a newer entry that lapped it
+        auto cur = std::atomic_load(&slot);
+        while (!cur || cur->seq < seq) {
+            if (std::atomic_compare_exchange_weak(&slot, &cur, node)) break;
+        }
+    }
+
+    // Logical clear: entries enqueued before this call stop being visible
+    void clear() { floor_.store(head_.load()); }
+
+    // ── Accessors ─────────────────────────────────────────
+    size_t size() const {
+        uint64_t head = head_.load(), floor = floor_.load();
+        return (size_t)std::min<uint64_t>(head > floor ? head - floor : 0, capacity_);
+    }
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return capacity_; }
+    size_t displaySize() const { return capacity_; }
+
+    // Get last N items, oldest first. Slots still being written by a
+    // concurrent producer are skipped rather than waited on.
+    std::vector<T> getLast(size_t n) const {
+        n = std::min(n, capacity_);
+        uint64_t head = head_.load();
+        uint64_t first = std::max<uint64_t>(floor_.load(), head > n ? head - n : 0);
+        std::vector<T> out;
+        out.reserve(head > first ? head - first : 0);
+        for (uint64_t seq = first; seq < head; seq++) {
+            auto node = std::atomic_load(&slots_[seq % capacity_]);
+            if (node && node->seq == seq) out.push_back(node->value);
+        }
+        return out;
+    }
+
+    // Get the display queue (every retained item)
+    std::vector<T> getDisplayQueue() const {
+        return getLast(capacity_);
+    }
+};
@@ -13,11 +13,26 @@
 #include <openssl/rand.h>
 #include <openssl/bio.h>
 #include <openssl/buffer.h>
+#include <openssl/bn.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#include <openssl/param_build.h>
+#else
+#include <openssl/rsa.h>
+#endif
 #endif
 
 #include "httplib.h"
 #include "json.hpp"
 #include "queue.hpp"
+#include "worker_pool.hpp"
+#include "lru_cache.hpp"
+#include "message_log.hpp"
+#include "compression.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "message.hpp"
+#include "crypto.hpp"
 
 #include <iostream>
 #include <fstream>
@@ -25,12 +40,22 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <mutex>
+#include <shared_mutex>
 #include <ctime>
 #include <cstring>
 #include <algorithm>
 #include <functional>
 #include <chrono>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <csignal>
+#include <memory>
+#include <filesystem>
 
 using json = nlohmann::json;
 using namespace httplib;
@@ -40,8 +65,18 @@ struct Config {
     std::string mongodb_uri;
     std::string encryption_key;
     std::string google_client_id;
+    std::string google_jwks_file;   // fixed signing keys instead of fetching Google's
     std::string jwt_secret;
     int port = 10000;
+    int mongo_pool_size = 16;
+    int message_cache_mb = 64;
+    int http_threads = 128;
+    std::string data_dir;
+    bool log_fsync = true;          // fsync every message log append (local mode)
+    bool static_reload = false;     // re-read public/ when files change (development)
+    std::string metrics_token;      // bearer token required by /metrics when set
+    bool server_timing = false;     // per-phase Server-Timing response header
+    int slow_request_ms = 0;        // log requests slower than this (0 = off)
 };
 
 static Config config;
@@ -77,31 +112,57 @@ void loadConfig() {
     config.mongodb_uri = env("MONGODB_URI");
     config.encryption_key = env("ENCRYPTION_KEY", "default-key-change-me");
     config.google_client_id = env("GOOGLE_CLIENT_ID");
+    config.google_jwks_file = env("GOOGLE_JWKS_FILE");
     config.jwt_secret = env("JWT_SECRET", "default-jwt-secret");
     config.port = std::stoi(env("PORT", "10000"));
+    config.mongo_pool_size = std::max(1, std::stoi(env("MONGODB_POOL_SIZE", "16")));
+    config.message_cache_mb = std::max(0, std::stoi(env("MESSAGE_CACHE_MB", "64")));
+    config.http_threads = std::max(8, std::stoi(env("HTTP_THREADS", "128")));
+    config.data_dir = env("DATA_DIR", "./data");
+    config.log_fsync = env("LOG_FSYNC", "1") != "0";
+    config.static_reload = env("STATIC_RELOAD", "0") == "1";
+    config.metrics_token = env("METRICS_TOKEN");
+    config.server_timing = env("SERVER_TIMING", "0") == "1";
+    config.slow_request_ms = std::max(0, std::stoi(env("SLOW_REQUEST_MS", "0")));
 }
 
-// ── Data Structures ───────────────────────────────────────
-struct Message {
-    std::string id;
-    std::string from;
-    std::string fromName;
-    std::string fromAvatar;
-    std::string to;
-    std::string toName;
-    std::string content;        // encrypted in DB, plain in memory
-    std::string chatType;       // "global" or "private"
-    int64_t timestamp;
-
-    json toJson() const {
-        return {
-            {"_id", id}, {"from", from}, {"fromName", fromName},
-            {"fromAvatar", fromAvatar}, {"to", to}, {"toName", toName},
-            {"content", content}, {"chatType", chatType}, {"timestamp", timestamp}
-        };
-    }
+// ── Metrics ───────────────────────────────────────────────
+// Exposed at /metrics. Series are registered during static initialisation
+// (here and next to the code they measure), before any thread records.
+// Per-route request latency and status classes. Paths outside the route
+// table are folded into "static" or "/api/other" to bound the label set.
+struct RouteMetrics {
+    Metrics::Histogram latency;
+    Metrics::Counter byClass[5];   // 1xx..5xx
 };
 
+RouteMetrics& routeMetrics(const std::string& path) {
+    static std::unordered_map<std::string, std::unique_ptr<RouteMetrics>> table = [] {
+        std::unordered_map<std::string, std::unique_ptr<RouteMetrics>> t;
+        for (const char* route : {"/healthz", "/api/config", "/api/auth/google", "/api/auth/simple",
+                                  "/api/users", "/api/messages", "/api/messages/wait", "/api/send",
+                                  "/api/clear", "/api/stats", "/api/download", "/metrics",
+                                  "/api/other", "static"}) {
+            std::string label = std::string("route=\"") + route + "\"";
+            auto m = std::make_unique<RouteMetrics>();
+            m->latency = latencyMetric("chat_http_request_duration_seconds",
+                                       "Time from routing to response headers", label);
+            for (int c = 0; c < 5; c++)
+                m->byClass[c] = metrics.counter("chat_http_requests_total", "Requests served",
+                                                label + ",code=\"" + std::to_string(c + 1) + "xx\"");
+            t[route] = std::move(m);
+        }
+        return t;
+    }();
+    auto it = table.find(path);
+    if (it != table.end()) return *it->second;
+    return *table.at(path.rfind("/api", 0) == 0 ? "/api/other" : "static");
+}
+
+static const Metrics::Counter httpInFlight =
+    metrics.gauge("chat_http_requests_in_flight", "Requests currently being handled");
+
+// ── Data Structures (Message: message.hpp) ────────────────
 struct User {
     std::string googleId;
     std::string email;
@@ -111,11 +172,542 @@ struct User {
 };
 
 // ── In-Memory Storage + Queue ─────────────────────────────
-static std::mutex dataMutex;
-static std::map<std::string, User> users;           // email -> User
-static Queue<Message> globalQueue(10);               // Queue visualization
-static std::vector<Message> allMessages;             // Full history
-static int messageCounter = 0;
+// State is split so readers never block each other and a writer blocks only
+// its own conversation: a user directory, one reader-writer lock per
+// conversation, and lock-free counters. There is no global data lock.
+static RingQueue<Message> globalQueue(10);           // Queue visualization (last 10)
+static std::atomic<size_t> totalMessages{0};
+static std::atomic<uint64_t> messageCounter{0};      // id suffix only
+// Last assigned message sequence number. Sequence numbers only grow, are
+// stored with each message, and back the exact `afterSeq` delta sync.
+static std::atomic<uint64_t> messageSeq{0};
+
+// Page sizes for GET /api/messages. Clients page with timestamp cursors
+// (`before` / `after`), so no request ever serializes a whole history.
+static const size_t DEFAULT_PAGE_SIZE = 100;
+static const size_t MAX_PAGE_SIZE = 500;
+
+// GET /api/messages/wait holds a request open at most this long (seconds)
+static const int LONG_POLL_DEFAULT_SEC = 25;
+static const int LONG_POLL_MAX_SEC = 55;
+
+// ── User Directory ────────────────────────────────────────
+// Every known user, plus the serialized GET /api/users body. A change to a
+// listed field (name, avatar, a new email) bumps the version behind the
+// response ETag; the body is rebuilt by the first reader after a change.
+class UserDirectory {
+    mutable std::shared_mutex mu_;
+    std::map<std::string, User> users_;  // email -> User
+    uint64_t version_ = 1;
+    const int64_t epoch_;                // keeps ETags unique across restarts
+
+    mutable std::mutex listingMu_;
+    mutable uint64_t listingVersion_ = 0;
+    mutable std::shared_ptr<const std::string> listing_;
+
+public:
+    struct Listing {
+        std::string etag;
+        std::shared_ptr<const std::string> body;  // {"users":[{email,name,avatar},...]}
+    };
+
+    UserDirectory()
+        : epoch_(std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count()) {}
+
+    // `persist` runs under the write lock, so concurrent upserts of one
+    // user reach the message log in the order they were applied here
+    void upsert(const User& user, const std::function<void(const User&)>& persist = nullptr) {
+        std::unique_lock<std::shared_mutex> lock(mu_);
+        auto it = users_.find(user.email);
+        if (it == users_.end() || it->second.name != user.name || it->second.avatar != user.avatar) version_++;
+        users_[user.email] = user;
+        if (persist) persist(user);
+    }
+
+    // Folds in a reload of the listed fields. Users missing from `loaded`
+    // are kept: they may be sign-ins whose upsert has not landed yet.
+    void merge(const std::vector<User>& loaded) {
+        std::unique_lock<std::shared_mutex> lock(mu_);
+        for (auto& u : loaded) {
+            if (u.email.empty()) continue;
+            auto it = users_.find(u.email);
+            if (it == users_.end()) {
+                users_[u.email] = u;
+                version_++;
+            } else if (it->second.name != u.name || it->second.avatar != u.avatar) {
+                it->second.name = u.name;
+                it->second.avatar = u.avatar;
+                version_++;
+            }
+        }
+    }
+
+    bool find(const std::string& email, User& out) const {
+        std::shared_lock<std::shared_mutex> lock(mu_);
+        auto it = users_.find(email);
+        if (it == users_.end()) return false;
+        out = it->second;
+        return true;
+    }
+
+    std::vector<User> list() const {
+        std::shared_lock<std::shared_mutex> lock(mu_);
+        std::vector<User> out;
+        out.reserve(users_.size());
+        for (auto& [email, u] : users_) out.push_back(u);
+        return out;
+    }
+
+    Listing listing() const {
+        std::lock_guard<std::mutex> guard(listingMu_);
+        std::shared_lock<std::shared_mutex> lock(mu_);
+        if (!listing_ || listingVersion_ != version_) {
+            json list = json::array();
+            for (auto& [email, u] : users_)
+                list.push_back({{"email", u.email}, {"name", u.name}, {"avatar", u.avatar}});
+            listing_ = std::make_shared<const std::string>(json({{"users", list}}).dump());
+            listingVersion_ = version_;
+        }
+        // Weak: the same listing may be sent gzip- or zstd-encoded
+        return {"W/\"" + std::to_string(epoch_) + "-" + std::to_string(listingVersion_) + "\"", listing_};
+    }
+
+    size_t size() const {
+        std::shared_lock<std::shared_mutex> lock(mu_);
+        return users_.size();
+    }
+};
+
+static UserDirectory users;
+
+// ── Durable Message Log (local mode) ──────────────────────
+// Without MongoDB, every change to the in-memory state is also appended to
+// a segmented binary log; startup maps the segments and replays them.
+//   message: u8 4 | i64 seq | i64 timestamp | id, from, fromName, fromAvatar, to, toName, content, chatType
+//   clear:   u8 2 | conversation key
+//   user:    u8 3 | i64 lastActive | googleId, email, name, avatar
+// Kind 1 is the message record without seq written by older builds; replay
+// numbers those in log order.
+#ifndef USE_MONGODB
+static const size_t LOG_SEGMENT_BYTES = 64 << 20;
+enum LogRecordKind : uint8_t { LOG_MESSAGE_V1 = 1, LOG_CLEAR = 2, LOG_USER = 3, LOG_MESSAGE = 4 };
+static std::unique_ptr<SegmentedLog> messageLog;
+
+// Records are written under the lock of the state they change, so log
+// order matches in-memory order; logSync() then waits for the disk after
+// that lock is released, sharing one fsync among concurrent writers.
+// `lsn` stays 0 without a log. False if the write failed; the record is
+// then not in the log and the change must not be applied.
+bool logWrite(const RecordWriter& rec, uint64_t& lsn) {
+    if (!messageLog) return true;
+    lsn = messageLog->write(rec);
+    if (!lsn) std::cerr << "Message log append failed" << std::endl;
+    return lsn != 0;
+}
+
+// Waits until the record at `lsn` is on disk (LOG_FSYNC)
+bool logSync(uint64_t lsn) {
+    if (!messageLog || !lsn || messageLog->sync(lsn)) return true;
+    std::cerr << "Message log fsync failed" << std::endl;
+    return false;
+}
+
+bool logMessage(const Message& m, uint64_t& lsn) {
+    RecordWriter rec;
+    rec.u8(LOG_MESSAGE);
+    rec.i64((int64_t)m.seq);
+    rec.i64(m.timestamp);
+    for (auto* f : {&m.id, &m.from, &m.fromName, &m.fromAvatar, &m.to, &m.toName, &m.content, &m.chatType})
+        rec.str(*f);
+    return logWrite(rec, lsn);
+}
+
+bool logClear(const std::string& key, uint64_t& lsn) {
+    RecordWriter rec;
+    rec.u8(LOG_CLEAR);
+    rec.str(key);
+    return logWrite(rec, lsn);
+}
+
+bool logUser(const User& u, uint64_t& lsn) {
+    RecordWriter rec;
+    rec.u8(LOG_USER);
+    rec.i64(u.lastActive);
+    for (auto* f : {&u.googleId, &u.email, &u.name, &u.avatar}) rec.str(*f);
+    return logWrite(rec, lsn);
+}
+#endif
+
+// ── Conversation Index ────────────────────────────────────
+// "global" for the public room, "<chatType>:<a>|<b>" (a < b) for DMs,
+// so both participants of a DM resolve to the same history.
+std::string conversationKey(const std::string& chatType, const std::string& a, const std::string& b) {
+    if (chatType == "global") return "global";
+    return a < b ? chatType + ":" + a + "|" + b : chatType + ":" + b + "|" + a;
+}
+
+std::string conversationKey(const Message& msg) {
+    return conversationKey(msg.chatType, msg.from, msg.to);
+}
+
+struct Conversation {
+    std::shared_mutex mu;
+    std::deque<Message> history;  // sorted by timestamp
+};
+
+// Key -> conversation. The map lock covers only lookup and creation.
+// Conversations are never removed (a clear empties one in place), so a
+// looked-up pointer stays valid after the map lock is released.
+class ConversationStore {
+    mutable std::shared_mutex mu_;
+    std::unordered_map<std::string, std::unique_ptr<Conversation>> map_;
+
+public:
+    Conversation* find(const std::string& key) const {
+        std::shared_lock<std::shared_mutex> lock(mu_);
+        auto it = map_.find(key);
+        return it == map_.end() ? nullptr : it->second.get();
+    }
+
+    Conversation& get(const std::string& key) {
+        if (Conversation* conv = find(key)) return *conv;
+        std::unique_lock<std::shared_mutex> lock(mu_);
+        auto& conv = map_[key];
+        if (!conv) conv.reset(new Conversation());
+        return *conv;
+    }
+};
+
+static ConversationStore conversations;
+
+// Conversation locks report how long callers queued for them and how long
+// they were held; read locks are the polling path, write locks are sends.
+struct LockMetrics {
+    Metrics::Histogram wait, hold;
+};
+
+LockMetrics lockMetrics(const char* mode) {
+    std::string label = std::string("mode=\"") + mode + "\"";
+    return {latencyMetric("chat_conversation_lock_wait_seconds", "Time spent acquiring a conversation lock", label),
+            latencyMetric("chat_conversation_lock_hold_seconds", "Time a conversation lock was held", label)};
+}
+
+static const LockMetrics readLockMetrics = lockMetrics("read");
+static const LockMetrics writeLockMetrics = lockMetrics("write");
+
+template<typename Lock>
+class TimedLock {
+    const LockMetrics& m_;
+    Lock lock_;
+    std::chrono::steady_clock::time_point acquired_;
+
+public:
+    TimedLock(std::shared_mutex& mu, const LockMetrics& m) : m_(m) {
+        auto start = std::chrono::steady_clock::now();
+        lock_ = Lock(mu);
+        acquired_ = std::chrono::steady_clock::now();
+        metrics.observe(m_.wait, acquired_ - start);
+        traceAdd("lock", acquired_ - start);
+    }
+    ~TimedLock() { metrics.observe(m_.hold, std::chrono::steady_clock::now() - acquired_); }
+    TimedLock(const TimedLock&) = delete;
+    TimedLock& operator=(const TimedLock&) = delete;
+};
+
+struct ReadLock : TimedLock<std::shared_lock<std::shared_mutex>> {
+    explicit ReadLock(std::shared_mutex& mu) : TimedLock(mu, readLockMetrics) {}
+};
+struct WriteLock : TimedLock<std::unique_lock<std::shared_mutex>> {
+    explicit WriteLock(std::shared_mutex& mu) : TimedLock(mu, writeLockMetrics) {}
+};
+
+// Keeps each history sorted by timestamp; new messages almost always land
+// at the back, so this is O(1) amortized. `persist` is false during replay.
+// A message without a sequence number is numbered here, under the write
+// lock, with its timestamp clamped to the newest one, so the history is
+// ordered by seq and timestamp alike and `afterSeq` readers never see a
+// later number before an earlier one. The message is sealed afterwards.
+// In local mode the log record is written under the same lock (a message
+// whose write fails is not indexed) and synced after it is released, so
+// readers never wait on the disk. False if the message was not persisted.
+bool indexMessage(Message& msg, bool persist = true) {
+    uint64_t lsn = 0;
+    {
+        Conversation& conv = conversations.get(conversationKey(msg));
+        WriteLock lock(conv.mu);
+        if (msg.seq == 0) {
+            if (!conv.history.empty()) msg.timestamp = std::max(msg.timestamp, conv.history.back().timestamp);
+            msg.seq = ++messageSeq;
+            msg.seal();
+        } else {
+            // Numbered by the log (replay) or chatWriter
+            uint64_t seen = messageSeq.load();
+            while (seen < msg.seq && !messageSeq.compare_exchange_weak(seen, msg.seq)) {}
+        }
+#ifndef USE_MONGODB
+        if (persist && !logMessage(msg, lsn)) return false;  // its seq is left unused
+#endif
+        auto pos = std::upper_bound(conv.history.begin(), conv.history.end(), msg.timestamp,
+            [](int64_t ts, const Message& m) { return ts < m.timestamp; });
+        conv.history.insert(pos, msg);
+        totalMessages++;
+    }
+#ifndef USE_MONGODB
+    return logSync(lsn);
+#else
+    (void)persist;
+    (void)lsn;
+    return true;
+#endif
+}
+
+// Copies up to `limit` messages newer than `sinceTs`. When the page edge
+// splits a run of equal timestamps the whole run is taken, so a caller that
+// resumes from the last timestamp neither skips nor repeats a message; if
+// that would exceed MAX_PAGE_SIZE the page ends before the run instead, and
+// a run longer than MAX_PAGE_SIZE on its own is cut (sequence paging has no
+// such limit). Binary searches only, so a page costs O(log n + limit).
+// `more` reports a remainder.
+std::vector<Message> collectMessagesSince(const std::string& key, int64_t sinceTs, size_t limit,
+                                          bool* more = nullptr) {
+    std::vector<Message> out;
+    if (more) *more = false;
+    Conversation* conv = conversations.find(key);
+    if (!conv) return out;
+    ReadLock lock(conv->mu);
+    auto& h = conv->history;
+    auto byTs = [](const Message& m, int64_t ts) { return m.timestamp < ts; };
+    auto tsBefore = [](int64_t ts, const Message& m) { return ts < m.timestamp; };
+    auto first = std::upper_bound(h.begin(), h.end(), sinceTs, tsBefore);
+    auto end = first + (ptrdiff_t)std::min<size_t>(limit, h.end() - first);
+    if (end != first && end != h.end() && std::prev(end)->timestamp == end->timestamp) {
+        int64_t edgeTs = end->timestamp;
+        auto runEnd = std::upper_bound(end, h.end(), edgeTs, tsBefore);
+        if ((size_t)(runEnd - first) <= MAX_PAGE_SIZE) {
+            end = runEnd;
+        } else {
+            auto runStart = std::lower_bound(first, end, edgeTs, byTs);
+            end = runStart != first ? runStart : first + (ptrdiff_t)MAX_PAGE_SIZE;
+        }
+    }
+    out.assign(first, end);
+    if (more) *more = end != h.end();
+    return out;
+}
+
+// The newest `limit` messages older than `beforeTs`, oldest first; the
+// mirror image of collectMessagesSince, with the same tie handling.
+std::vector<Message> collectMessagesBefore(const std::string& key, int64_t beforeTs, size_t limit,
+                                           bool* more = nullptr) {
+    std::vector<Message> out;
+    if (more) *more = false;
+    Conversation* conv = conversations.find(key);
+    if (!conv) return out;
+    ReadLock lock(conv->mu);
+    auto& h = conv->history;
+    auto byTs = [](const Message& m, int64_t ts) { return m.timestamp < ts; };
+    auto tsBefore = [](int64_t ts, const Message& m) { return ts < m.timestamp; };
+    auto end = std::lower_bound(h.begin(), h.end(), beforeTs, byTs);
+    auto first = end - (ptrdiff_t)std::min<size_t>(limit, end - h.begin());
+    if (first != end && first != h.begin() && std::prev(first)->timestamp == first->timestamp) {
+        int64_t edgeTs = first->timestamp;
+        auto runStart = std::lower_bound(h.begin(), first, edgeTs, byTs);
+        if ((size_t)(end - runStart) <= MAX_PAGE_SIZE) {
+            first = runStart;
+        } else {
+            auto runEnd = std::upper_bound(first, end, edgeTs, tsBefore);
+            first = runEnd != end ? runEnd : end - (ptrdiff_t)MAX_PAGE_SIZE;
+        }
+    }
+    out.assign(first, end);
+    if (more) *more = first != h.begin();
+    return out;
+}
+
+// Up to `limit` messages numbered above `afterSeq`. Only valid for histories
+// numbered by indexMessage (local mode, or MongoDB builds without a server).
+std::vector<Message> collectMessagesAfterSeq(const std::string& key, uint64_t afterSeq, size_t limit,
+                                             bool* more = nullptr) {
+    std::vector<Message> out;
+    if (more) *more = false;
+    Conversation* conv = conversations.find(key);
+    if (!conv) return out;
+    ReadLock lock(conv->mu);
+    auto first = std::upper_bound(conv->history.begin(), conv->history.end(), afterSeq,
+        [](uint64_t seq, const Message& m) { return seq < m.seq; });
+    auto last = first + std::min<size_t>(limit, conv->history.end() - first);
+    out.assign(first, last);
+    if (more) *more = last != conv->history.end();
+    return out;
+}
+
+// False if the clear could not be persisted; the history is then kept
+bool clearConversation(const std::string& key, bool persist = true) {
+    uint64_t lsn = 0;
+    {
+        Conversation* conv = conversations.find(key);
+        if (!conv) return true;
+        WriteLock lock(conv->mu);
+#ifndef USE_MONGODB
+        if (persist && !logClear(key, lsn)) return false;
+#endif
+        totalMessages -= conv->history.size();
+        conv->history.clear();
+        conv->history.shrink_to_fit();
+    }
+#ifndef USE_MONGODB
+    return logSync(lsn);
+#else
+    (void)persist;
+    (void)lsn;
+    return true;
+#endif
+}
+
+#ifndef USE_MONGODB
+// Called for each record during startup replay, before the server listens
+void replayRecord(const char* data, size_t size) {
+    RecordReader in(data, size);
+    uint8_t kind = in.u8();
+    switch (kind) {
+    case LOG_MESSAGE:
+    case LOG_MESSAGE_V1: {
+        Message m;
+        if (kind == LOG_MESSAGE) m.seq = (uint64_t)in.i64();
+        m.timestamp = in.i64();
+        for (auto* f : {&m.id, &m.from, &m.fromName, &m.fromAvatar, &m.to, &m.toName, &m.content, &m.chatType})
+            *f = in.str();
+        if (!in.ok()) break;
+        if (m.seq) m.seal();  // V1 records are numbered and sealed by indexMessage
+        indexMessage(m, false);
+        break;
+    }
+    case LOG_CLEAR: {
+        std::string key = in.str();
+        if (in.ok()) clearConversation(key, false);
+        break;
+    }
+    case LOG_USER: {
+        User u;
+        u.lastActive = in.i64();
+        for (auto* f : {&u.googleId, &u.email, &u.name, &u.avatar}) *f = in.str();
+        if (in.ok()) users.upsert(u);
+        break;
+    }
+    default:
+        break;
+    }
+}
+#endif
+
+// FNV-1a, hex; names content in ETags and asset URLs
+std::string contentHash(const std::string& data) {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : data) h = (h ^ c) * 1099511628211ull;
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)h);
+    return hex;
+}
+
+// ── Conversation Change Notifier ──────────────────────────
+// Long-poll requests park on their conversation's slot until a new message
+// becomes readable there. Reading the version before querying lets a
+// waiter notice a message that lands between its query and its wait.
+class ChangeNotifier {
+    struct Slot {
+        std::condition_variable cv;
+        uint64_t version = 0;
+        int waiters = 0;
+    };
+    std::mutex mu_;
+    std::unordered_map<std::string, std::unique_ptr<Slot>> slots_;
+    const int64_t epoch_;   // versions restart at 0; keeps ETags unique across restarts
+
+    Slot& slotLocked(const std::string& key) {
+        auto& slot = slots_[key];
+        if (!slot) slot.reset(new Slot());
+        return *slot;
+    }
+
+public:
+    ChangeNotifier()
+        : epoch_(std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::system_clock::now().time_since_epoch()).count()) {}
+
+    uint64_t version(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mu_);
+        auto it = slots_.find(key);
+        return it == slots_.end() ? 0 : it->second->version;
+    }
+
+    // Validator for anything derived from the conversation. Read it before
+    // fetching: a change that races the fetch then only costs a spare 200.
+    // It names the conversation, since one URL (`?chatType=private&with=x`)
+    // means a different DM for each signed-in user, and the process epoch,
+    // since versions are per process. Several processes serving one store
+    // would each have their own versions; in MongoDB mode only the writer
+    // lease holder serves, and local mode owns its log directory.
+    std::string etag(const std::string& key) {
+        return "W/\"" + std::to_string(epoch_) + "-" + contentHash(key) + "-" + std::to_string(version(key)) + "\"";
+    }
+
+    void notify(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mu_);
+        Slot& slot = slotLocked(key);
+        slot.version++;
+        slot.cv.notify_all();
+    }
+
+    // Returns the current version; equal to `seen` if the deadline passed first.
+    // A slot nobody waits on and nothing was ever sent to is dropped again.
+    uint64_t waitForChange(const std::string& key, uint64_t seen,
+                           std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(mu_);
+        Slot& slot = slotLocked(key);
+        slot.waiters++;
+        slot.cv.wait_until(lock, deadline, [&] { return slot.version != seen; });
+        uint64_t version = slot.version;
+        if (--slot.waiters == 0 && version == 0) slots_.erase(key);
+        return version;
+    }
+};
+
+static ChangeNotifier changeNotifier;
+
+// ── Long-poll admission ───────────────────────────────────
+// Every parked wait holds an HTTP worker, so waiters may take all but a
+// fixed reserve of the pool. The reserve is best effort: httplib also
+// holds a worker for each idle keep-alive connection. Past the cap a wait
+// returns at once with a retry hint no shorter than the old 3.5 s polling
+// interval, which clients grow while the cap persists (see README).
+static const int HTTP_RESERVED_THREADS = 16;
+static const int LONG_POLL_RETRY_MS = 3500;
+
+static std::atomic<int> longPollWaiters{0};
+static const Metrics::Counter longPollRejected =
+    metrics.counter("chat_long_poll_rejected_total", "Long-polls turned away because every waiter place was taken");
+
+int longPollCapacity() {
+    return config.http_threads - std::min(HTTP_RESERVED_THREADS, config.http_threads / 2);
+}
+
+// Holds one waiter place for the scope it lives in
+class LongPollGate {
+    bool entered_ = false;
+
+public:
+    bool tryEnter() {
+        if (longPollWaiters.fetch_add(1) >= longPollCapacity()) {
+            longPollWaiters--;
+            metrics.add(longPollRejected);
+            return false;
+        }
+        entered_ = true;
+        return true;
+    }
+    ~LongPollGate() { if (entered_) longPollWaiters--; }
+};
 
 int64_t nowMs() {
     return std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -123,379 +715,1563 @@ int64_t nowMs() {
     ).count();
 }
 
-std::string genId() {
-    return std::to_string(nowMs()) + "_" + std::to_string(++messageCounter);
+std::string genId() {
+    return std::to_string(nowMs()) + "_" + std::to_string(messageCounter.fetch_add(1) + 1);
+}
+
+// ═══════════════════════════════════════════════════════════
+//  MongoDB Operations (when USE_MONGODB is defined)
+// ═══════════════════════════════════════════════════════════
+
+#ifdef USE_MONGODB
+// A single mongoc_client_t is not thread-safe, so every httplib worker
+// borrows its own client from this pool for the duration of one operation.
+static mongoc_client_pool_t* mongoPool = nullptr;
+static bool mongoConnected = false;
+
+// Time spent blocked in mongoc_client_pool_pop (pool exhausted)
+struct PoolStats {
+    std::atomic<uint64_t> pops{0};
+    std::atomic<uint64_t> waitUsTotal{0};
+    std::atomic<uint64_t> waitUsMax{0};
+
+    json toJson() const {
+        uint64_t n = pops.load();
+        return {
+            {"size", config.mongo_pool_size}, {"pops", n},
+            {"avgWaitUs", n ? waitUsTotal.load() / n : 0}, {"maxWaitUs", waitUsMax.load()}
+        };
+    }
+};
+static PoolStats poolStats;
+static const Metrics::Histogram mongoPoolWaitTime =
+    latencyMetric("chat_mongo_pool_wait_seconds", "Time blocked waiting for a pooled MongoDB client");
+
+// Latency of each mongo* helper, pool wait included
+Metrics::Histogram mongoOpMetric(const char* op) {
+    return latencyMetric("chat_mongo_op_duration_seconds", "MongoDB operation latency",
+                         std::string("op=\"") + op + "\"");
+}
+
+static const Metrics::Histogram mongoUpsertUserTime = mongoOpMetric("upsertUser");
+static const Metrics::Histogram mongoInsertChatsTime = mongoOpMetric("insertChats");
+static const Metrics::Histogram mongoFindChatsTime = mongoOpMetric("findChats");
+static const Metrics::Histogram mongoDeleteChatsTime = mongoOpMetric("deleteChats");
+static const Metrics::Histogram mongoFindUsersTime = mongoOpMetric("findUsers");
+
+// RAII lease on a pooled client; pushed back when it goes out of scope
+class PooledClient {
+    mongoc_client_t* client_ = nullptr;
+
+public:
+    PooledClient() {
+        if (!mongoPool) return;
+        auto start = std::chrono::steady_clock::now();
+        client_ = mongoc_client_pool_pop(mongoPool);
+        auto waited = std::chrono::steady_clock::now() - start;
+        metrics.observe(mongoPoolWaitTime, waited);
+        uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(waited).count();
+        poolStats.pops++;
+        poolStats.waitUsTotal += us;
+        uint64_t prev = poolStats.waitUsMax.load();
+        while (us > prev && !poolStats.waitUsMax.compare_exchange_weak(prev, us)) {}
+    }
+    ~PooledClient() { if (client_) mongoc_client_pool_push(mongoPool, client_); }
+    PooledClient(const PooledClient&) = delete;
+    PooledClient& operator=(const PooledClient&) = delete;
+
+    mongoc_client_t* get() const { return client_; }
+    explicit operator bool() const { return client_ != nullptr; }
+};
+
+bool mongoConnect() {
+    mongoc_init();
+    bson_error_t err;
+    mongoc_uri_t* uri = mongoc_uri_new_with_error(config.mongodb_uri.c_str(), &err);
+    if (!uri) {
+        std::cerr << "MongoDB URI error: " << err.message << std::endl;
+        return false;
+    }
+    mongoPool = mongoc_client_pool_new(uri);
+    mongoc_uri_destroy(uri);
+    if (!mongoPool) return false;
+    mongoc_client_pool_set_error_api(mongoPool, MONGOC_ERROR_API_VERSION_2);
+    mongoc_client_pool_set_appname(mongoPool, "ChatAppLogger-CPP");
+    mongoc_client_pool_max_size(mongoPool, config.mongo_pool_size);
+
+    PooledClient client;
+    if (!client) return false;
+
+    bson_t* cmd = BCON_NEW("ping", BCON_INT32(1));
+    bson_t reply;
+    bool ok = mongoc_client_command_simple(client.get(), "admin", cmd, NULL, &reply, &err);
+    bson_destroy(cmd);
+    bson_destroy(&reply);
+    if (!ok) {
+        std::cerr << "MongoDB error: " << err.message << std::endl;
+        return false;
+    }
+
+    // Drop legacy username index if exists
+    mongoc_collection_t* col = mongoc_client_get_collection(client.get(), "ChatLogger", "Users");
+    mongoc_collection_drop_index(col, "username_1", NULL);
+    mongoc_collection_destroy(col);
+
+    // Compound indexes backing GET /api/messages: equality on the conversation,
+    // range + sort on timestamp (cursor pages) or seq (afterSeq deltas); seq_1
+    // finds the last sequence number at startup. BCON keeps key order (json
+    // objects would not).
+    bson_t* idx = BCON_NEW(
+        "createIndexes", BCON_UTF8("Chats"),
+        "indexes", "[",
+            "{", "key", "{", "chatType", BCON_INT32(1), "timestamp", BCON_INT32(1), "}",
+                 "name", BCON_UTF8("chatType_1_timestamp_1"), "}",
+            "{", "key", "{", "chatType", BCON_INT32(1), "from", BCON_INT32(1),
+                             "to", BCON_INT32(1), "timestamp", BCON_INT32(1), "}",
+                 "name", BCON_UTF8("chatType_1_from_1_to_1_timestamp_1"), "}",
+            "{", "key", "{", "chatType", BCON_INT32(1), "seq", BCON_INT32(1), "}",
+                 "name", BCON_UTF8("chatType_1_seq_1"), "}",
+            "{", "key", "{", "chatType", BCON_INT32(1), "from", BCON_INT32(1),
+                             "to", BCON_INT32(1), "seq", BCON_INT32(1), "}",
+                 "name", BCON_UTF8("chatType_1_from_1_to_1_seq_1"), "}",
+            "{", "key", "{", "seq", BCON_INT32(1), "}", "name", BCON_UTF8("seq_1"), "}",
+        "]");
+    bson_t idxReply;
+    if (!mongoc_client_command_simple(client.get(), "ChatLogger", idx, NULL, &idxReply, &err))
+        std::cerr << "MongoDB createIndexes warning: " << err.message << std::endl;
+    bson_destroy(idx);
+    bson_destroy(&idxReply);
+
+    mongoConnected = true;
+    return true;
+}
+
+// ── BSON codec ────────────────────────────────────────────
+// Messages and users are appended to / iterated from bson_t directly, with
+// native date and ObjectId types; nothing goes through extended JSON.
+using BsonPtr = std::unique_ptr<bson_t, void (*)(bson_t*)>;
+
+BsonPtr bsonPtr(bson_t* doc) { return BsonPtr(doc, bson_destroy); }
+
+void bsonAppendString(bson_t* doc, const char* key, const std::string& value) {
+    bson_append_utf8(doc, key, -1, value.data(), (int)value.size());
+}
+
+std::string bsonIterString(const bson_iter_t* it) {
+    uint32_t len = 0;
+    const char* str = bson_iter_utf8(it, &len);
+    return std::string(str, len);
+}
+
+// Stored chat document; `content` is the encrypted text
+BsonPtr chatToBson(const Message& msg, const std::string& content, const bson_oid_t* id) {
+    BsonPtr doc = bsonPtr(bson_new());
+    BSON_APPEND_OID(doc.get(), "_id", id);
+    bsonAppendString(doc.get(), "from", msg.from);
+    bsonAppendString(doc.get(), "fromName", msg.fromName);
+    bsonAppendString(doc.get(), "fromAvatar", msg.fromAvatar);
+    bsonAppendString(doc.get(), "to", msg.to);
+    bsonAppendString(doc.get(), "toName", msg.toName);
+    bsonAppendString(doc.get(), "content", content);
+    bsonAppendString(doc.get(), "chatType", msg.chatType);
+    BSON_APPEND_INT64(doc.get(), "seq", (int64_t)msg.seq);
+    BSON_APPEND_DATE_TIME(doc.get(), "timestamp", msg.timestamp);
+    return doc;
+}
+
+// Reads a stored chat document as-is (content still encrypted). Missing
+// fields get the same defaults the JSON path used: a generated id, the
+// global room, the current time, and seq 0 for pre-sequence documents.
+Message chatFromBson(const bson_t* doc) {
+    Message msg;
+    msg.chatType = "global";
+    msg.timestamp = 0;
+    bool hasTimestamp = false;
+    bson_iter_t it;
+    if (bson_iter_init(&it, doc)) {
+        while (bson_iter_next(&it)) {
+            const char* key = bson_iter_key(&it);
+            bson_type_t type = bson_iter_type(&it);
+            if (!strcmp(key, "_id")) {
+                if (type == BSON_TYPE_OID) {
+                    char hex[25];
+                    bson_oid_to_string(bson_iter_oid(&it), hex);
+                    msg.id = hex;
+                } else if (type == BSON_TYPE_UTF8) {
+                    msg.id = bsonIterString(&it);
+                }
+            } else if (!strcmp(key, "timestamp")) {
+                if (type == BSON_TYPE_DATE_TIME) msg.timestamp = bson_iter_date_time(&it);
+                else if (BSON_ITER_HOLDS_NUMBER(&it)) msg.timestamp = bson_iter_as_int64(&it);
+                hasTimestamp = type == BSON_TYPE_DATE_TIME || BSON_ITER_HOLDS_NUMBER(&it);
+            } else if (!strcmp(key, "seq")) {
+                if (BSON_ITER_HOLDS_NUMBER(&it)) msg.seq = (uint64_t)bson_iter_as_int64(&it);
+            } else if (type == BSON_TYPE_UTF8) {
+                std::string* field =
+                    !strcmp(key, "from") ? &msg.from : !strcmp(key, "fromName") ? &msg.fromName :
+                    !strcmp(key, "fromAvatar") ? &msg.fromAvatar : !strcmp(key, "to") ? &msg.to :
+                    !strcmp(key, "toName") ? &msg.toName : !strcmp(key, "content") ? &msg.content :
+                    !strcmp(key, "chatType") ? &msg.chatType : nullptr;
+                if (field) *field = bsonIterString(&it);
+            }
+        }
+    }
+    if (msg.id.empty()) msg.id = genId();
+    if (!hasTimestamp) msg.timestamp = nowMs();
+    return msg;
+}
+
+User userFromBson(const bson_t* doc) {
+    User user{"", "", "", "", 0};
+    bson_iter_t it;
+    if (!bson_iter_init(&it, doc)) return user;
+    while (bson_iter_next(&it)) {
+        const char* key = bson_iter_key(&it);
+        if (!strcmp(key, "lastActive") && BSON_ITER_HOLDS_DATE_TIME(&it)) {
+            user.lastActive = bson_iter_date_time(&it);
+        } else if (BSON_ITER_HOLDS_UTF8(&it)) {
+            std::string* field =
+                !strcmp(key, "googleId") ? &user.googleId : !strcmp(key, "email") ? &user.email :
+                !strcmp(key, "name") ? &user.name : !strcmp(key, "avatar") ? &user.avatar : nullptr;
+            if (field) *field = bsonIterString(&it);
+        }
+    }
+    return user;
+}
+
+void mongoUpsertUser(const User& user) {
+    if (!mongoConnected) return;
+    Metrics::Timer timer(metrics, mongoUpsertUserTime);
+    TracePhase phase("mongo");
+    PooledClient client;
+    if (!client) return;
+    mongoc_collection_t* col = mongoc_client_get_collection(client.get(), "ChatLogger", "Users");
+
+    BsonPtr filter = bsonPtr(bson_new());
+    bsonAppendString(filter.get(), "googleId", user.googleId);
+
+    BsonPtr update = bsonPtr(bson_new());
+    bson_t set, setOnInsert;
+    BSON_APPEND_DOCUMENT_BEGIN(update.get(), "$set", &set);
+    bsonAppendString(&set, "googleId", user.googleId);
+    bsonAppendString(&set, "email", user.email);
+    bsonAppendString(&set, "name", user.name);
+    bsonAppendString(&set, "avatar", user.avatar);
+    BSON_APPEND_DATE_TIME(&set, "lastActive", user.lastActive);
+    bson_append_document_end(update.get(), &set);
+    BSON_APPEND_DOCUMENT_BEGIN(update.get(), "$setOnInsert", &setOnInsert);
+    BSON_APPEND_DATE_TIME(&setOnInsert, "createdAt", nowMs());
+    bson_append_document_end(update.get(), &setOnInsert);
+
+    BsonPtr opts = bsonPtr(BCON_NEW("upsert", BCON_BOOL(true)));
+    bson_error_t err;
+    mongoc_collection_update_one(col, filter.get(), update.get(), opts.get(), NULL, &err);
+    mongoc_collection_destroy(col);
+}
+
+// Inserts a group-committed batch; `encrypted[i]` is the stored content of `msgs[i]`
+// True if every write error in an insert_many reply is a duplicate key,
+// i.e. the documents were stored by an earlier attempt
+bool onlyDuplicateKeys(const bson_t* reply) {
+    bson_iter_t it, errors;
+    if (bson_iter_init_find(&it, reply, "writeConcernErrors")) return false;
+    if (!bson_iter_init_find(&it, reply, "writeErrors") || !BSON_ITER_HOLDS_ARRAY(&it) ||
+        !bson_iter_recurse(&it, &errors))
+        return false;
+    bool any = false;
+    while (bson_iter_next(&errors)) {
+        bson_iter_t code;
+        if (!BSON_ITER_HOLDS_DOCUMENT(&errors) || !bson_iter_recurse(&errors, &code) ||
+            !bson_iter_find(&code, "code") || bson_iter_as_int64(&code) != 11000)
+            return false;
+        any = true;
+    }
+    return any;
+}
+
+// Stores `msgs` with the given `ids`. Ids are fixed by the caller so that
+// retrying a partly stored batch is idempotent.
+bool mongoInsertChats(const std::vector<Message>& msgs, const std::vector<std::string>& encrypted,
+                      const std::vector<bson_oid_t>& ids) {
+    if (!mongoConnected || msgs.empty()) return true;
+    Metrics::Timer timer(metrics, mongoInsertChatsTime);
+    TracePhase phase("mongo");
+    PooledClient client;
+    if (!client) return false;
+    mongoc_collection_t* col = mongoc_client_get_collection(client.get(), "ChatLogger", "Chats");
+
+    std::vector<BsonPtr> docs;
+    std::vector<const bson_t*> raw;
+    docs.reserve(msgs.size());
+    for (size_t i = 0; i < msgs.size(); i++) {
+        docs.push_back(chatToBson(msgs[i], encrypted[i], &ids[i]));
+        raw.push_back(docs.back().get());
+    }
+
+    // Unordered: one bad document must not hold back the rest of the batch
+    BsonPtr opts = bsonPtr(BCON_NEW("ordered", BCON_BOOL(false)));
+    bson_error_t err;
+    bson_t reply;
+    bool ok = mongoc_collection_insert_many(col, raw.data(), raw.size(), opts.get(), &reply, &err);
+    if (!ok && onlyDuplicateKeys(&reply)) ok = true;
+    if (!ok) std::cerr << "MongoDB insert_many error: " << err.message << std::endl;
+    bson_destroy(&reply);
+
+    mongoc_collection_destroy(col);
+    return ok;
+}
+
+// Filter for one conversation: the global room or both directions of a DM
+BsonPtr mongoChatQuery(const std::string& chatType, const std::string& email, const std::string& withUser) {
+    if (chatType == "global") return bsonPtr(BCON_NEW("chatType", BCON_UTF8("global")));
+    return bsonPtr(BCON_NEW("chatType", BCON_UTF8("private"), "$or", "[",
+        "{", "from", BCON_UTF8(email.c_str()), "to", BCON_UTF8(withUser.c_str()), "}",
+        "{", "from", BCON_UTF8(withUser.c_str()), "to", BCON_UTF8(email.c_str()), "}",
+    "]"));
+}
+
+// Stored chats matching `query` under find options `opts` (sort, limit),
+// content still encrypted
+std::vector<Message> mongoFindChatsWithOpts(const bson_t* query, const bson_t* opts) {
+    if (!mongoConnected) return {};
+    Metrics::Timer timer(metrics, mongoFindChatsTime);
+    TracePhase phase("mongo");
+    PooledClient client;
+    if (!client) return {};
+    mongoc_collection_t* col = mongoc_client_get_collection(client.get(), "ChatLogger", "Chats");
+
+    mongoc_cursor_t* cursor = mongoc_collection_find_with_opts(col, query, opts, NULL);
+    const bson_t* doc;
+    std::vector<Message> results;
+    while (mongoc_cursor_next(cursor, &doc)) {
+        results.push_back(chatFromBson(doc));
+    }
+    bson_error_t err;
+    if (mongoc_cursor_error(cursor, &err)) std::cerr << "MongoDB find error: " << err.message << std::endl;
+
+    mongoc_cursor_destroy(cursor);
+    mongoc_collection_destroy(col);
+    return results;
+}
+
+// Stored chats sorted by `sortField` (`sortDir` 1 = ascending, -1 =
+// descending), content still encrypted; `limit` <= 0 means unbounded
+std::vector<Message> mongoFindChats(const bson_t* query, int64_t limit = 0, int sortDir = 1,
+                                    const char* sortField = "timestamp") {
+    BsonPtr opts = bsonPtr(BCON_NEW("sort", "{", sortField, BCON_INT32(sortDir), "}"));
+    if (limit > 0) BSON_APPEND_INT64(opts.get(), "limit", limit);
+    return mongoFindChatsWithOpts(query, opts.get());
+}
+
+// One page of a conversation (`conversation` from mongoChatQuery), oldest
+// first: `older` pages end before `boundTs` (0 = the newest page), newer
+// pages start after it. Both are range scans on the {chatType, ...,
+// timestamp} indexes. Reads limit+1 documents to learn whether more remain.
+// A run of equal timestamps split by the page edge is handled as in
+// collectMessagesSince: re-read whole (in paging order, so it survives the
+// final reverse), or left for the next page when it would take the page
+// past MAX_PAGE_SIZE.
+std::vector<Message> mongoFindChatPage(const bson_t* conversation, bool older, int64_t boundTs,
+                                       int64_t limit, bool& more) {
+    BsonPtr query = bsonPtr(bson_copy(conversation));
+    if (!older || boundTs > 0)
+        BCON_APPEND(query.get(), "timestamp", "{", older ? "$lt" : "$gt", BCON_DATE_TIME(boundTs), "}");
+
+    std::vector<Message> docs = mongoFindChats(query.get(), limit + 1, older ? -1 : 1);
+    more = (int64_t)docs.size() > limit;
+    if (more) {
+        int64_t edgeTs = docs[limit - 1].timestamp;
+        bool split = docs[limit].timestamp == edgeTs;
+        docs.resize(limit);
+        if (split) {
+            while (!docs.empty() && docs.back().timestamp == edgeTs) docs.pop_back();
+            int64_t room = (int64_t)MAX_PAGE_SIZE - (int64_t)docs.size();
+            BsonPtr run = bsonPtr(bson_copy(conversation));
+            BSON_APPEND_DATE_TIME(run.get(), "timestamp", edgeTs);
+            BsonPtr opts = bsonPtr(BCON_NEW("sort", "{", "_id", BCON_INT32(older ? -1 : 1), "}",
+                                            "limit", BCON_INT64(room + 1)));
+            std::vector<Message> tie = mongoFindChatsWithOpts(run.get(), opts.get());
+            if ((int64_t)tie.size() > room) {
+                if (!docs.empty()) tie.clear();  // the run starts the next page
+                else tie.resize(room);
+            }
+            for (auto& d : tie) docs.push_back(std::move(d));
+        }
+    }
+    if (older) std::reverse(docs.begin(), docs.end());
+    return docs;
+}
+
+// Highest stored sequence number (0 for an empty or unnumbered collection)
+uint64_t mongoFindLastSeq() {
+    BsonPtr all = bsonPtr(bson_new());
+    auto docs = mongoFindChats(all.get(), 1, -1, "seq");
+    return docs.empty() ? 0 : docs[0].seq;
+}
+
+// Up to `limit` chats of `conversation` in (timestamp, _id) order, starting
+// after `last` (nullptr = from the beginning). Each call leases a pooled
+// client only for its own query, so a long export paced by a slow reader
+// never pins one.
+std::vector<Message> mongoFindChatsAfter(const bson_t* conversation, const Message* last, int64_t limit) {
+    BsonPtr opts = bsonPtr(BCON_NEW("sort", "{", "timestamp", BCON_INT32(1), "_id", BCON_INT32(1), "}",
+                                    "limit", BCON_INT64(limit)));
+    if (!last) return mongoFindChatsWithOpts(conversation, opts.get());
+
+    // Ids of stored documents are ObjectIds; chatFromBson printed them as hex
+    BsonPtr idGt = bsonPtr(bson_new());
+    bson_oid_t oid;
+    if (bson_oid_is_valid(last->id.c_str(), last->id.size())) {
+        bson_oid_init_from_string(&oid, last->id.c_str());
+        BSON_APPEND_OID(idGt.get(), "$gt", &oid);
+    } else {
+        bsonAppendString(idGt.get(), "$gt", last->id);
+    }
+    // $and: a DM's conversation filter already uses the top-level $or
+    BsonPtr query = bsonPtr(BCON_NEW("$and", "[",
+        BCON_DOCUMENT(conversation),
+        "{", "$or", "[",
+            "{", "timestamp", "{", "$gt", BCON_DATE_TIME(last->timestamp), "}", "}",
+            "{", "timestamp", BCON_DATE_TIME(last->timestamp), "_id", BCON_DOCUMENT(idGt.get()), "}",
+        "]", "}",
+    "]"));
+    return mongoFindChatsWithOpts(query.get(), opts.get());
+}
+
+void mongoDeleteChats(const bson_t* query) {
+    if (!mongoConnected) return;
+    Metrics::Timer timer(metrics, mongoDeleteChatsTime);
+    TracePhase phase("mongo");
+    PooledClient client;
+    if (!client) return;
+    mongoc_collection_t* col = mongoc_client_get_collection(client.get(), "ChatLogger", "Chats");
+    bson_error_t err;
+    mongoc_collection_delete_many(col, query, NULL, NULL, &err);
+    mongoc_collection_destroy(col);
+}
+
+// Claims or renews the single-writer lease (see WriterLease) for `owner`
+// until `untilMs`. False if another live instance holds it or Mongo is
+// unreachable; a held lease makes the upsert hit a duplicate _id.
+bool mongoClaimWriterLease(const std::string& owner, int64_t untilMs) {
+    if (!mongoConnected) return false;
+    PooledClient client;
+    if (!client) return false;
+    mongoc_collection_t* col = mongoc_client_get_collection(client.get(), "ChatLogger", "Leases");
+    BsonPtr filter = bsonPtr(BCON_NEW("_id", BCON_UTF8("chatWriter"), "$or", "[",
+        "{", "owner", BCON_UTF8(owner.c_str()), "}",
+        "{", "expiresAt", "{", "$lt", BCON_DATE_TIME(nowMs()), "}", "}",
+    "]"));
+    BsonPtr update = bsonPtr(BCON_NEW("$set", "{", "owner", BCON_UTF8(owner.c_str()),
+                                                   "expiresAt", BCON_DATE_TIME(untilMs), "}"));
+    BsonPtr opts = bsonPtr(BCON_NEW("upsert", BCON_BOOL(true)));
+    bson_error_t err;
+    bool ok = mongoc_collection_update_one(col, filter.get(), update.get(), opts.get(), NULL, &err);
+    mongoc_collection_destroy(col);
+    return ok;
+}
+
+void mongoReleaseWriterLease(const std::string& owner) {
+    if (!mongoConnected) return;
+    PooledClient client;
+    if (!client) return;
+    mongoc_collection_t* col = mongoc_client_get_collection(client.get(), "ChatLogger", "Leases");
+    BsonPtr filter = bsonPtr(BCON_NEW("_id", BCON_UTF8("chatWriter"), "owner", BCON_UTF8(owner.c_str())));
+    bson_error_t err;
+    mongoc_collection_delete_one(col, filter.get(), NULL, NULL, &err);
+    mongoc_collection_destroy(col);
+}
+
+std::vector<User> mongoFindUsers() {
+    if (!mongoConnected) return {};
+    Metrics::Timer timer(metrics, mongoFindUsersTime);
+    TracePhase phase("mongo");
+    PooledClient client;
+    if (!client) return {};
+    mongoc_collection_t* col = mongoc_client_get_collection(client.get(), "ChatLogger", "Users");
+    BsonPtr query = bsonPtr(bson_new());
+    // Only the fields GET /api/users lists
+    BsonPtr opts = bsonPtr(BCON_NEW("projection", "{", "_id", BCON_INT32(0), "email", BCON_INT32(1),
+                                    "name", BCON_INT32(1), "avatar", BCON_INT32(1), "}"));
+    mongoc_cursor_t* cursor = mongoc_collection_find_with_opts(col, query.get(), opts.get(), NULL);
+    const bson_t* doc;
+    std::vector<User> results;
+    while (mongoc_cursor_next(cursor, &doc)) {
+        results.push_back(userFromBson(doc));
+    }
+    mongoc_cursor_destroy(cursor);
+    mongoc_collection_destroy(col);
+    return results;
+}
+#endif // USE_MONGODB
+
+// ═══════════════════════════════════════════════════════════
+//  Message Decryption (AES and JWT primitives: crypto.hpp)
+// ═══════════════════════════════════════════════════════════
+
+// Decrypts `content` in place; large batches fan out across a worker pool
+static const size_t PARALLEL_DECRYPT_MIN = 64;
+static const size_t DECRYPT_GRAIN = 32;
+
+void decryptMessages(std::vector<Message>& msgs) {
+    TracePhase phase("decrypt");
+    auto decryptOne = [&](size_t i) { msgs[i].content = aes_decrypt(msgs[i].content, config.encryption_key); };
+    if (msgs.size() < PARALLEL_DECRYPT_MIN) {
+        for (size_t i = 0; i < msgs.size(); i++) decryptOne(i);
+        return;
+    }
+    static WorkerPool decryptPool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    decryptPool.parallelFor(msgs.size(), DECRYPT_GRAIN, decryptOne);
+}
+
+#ifdef USE_MONGODB
+// ── Decrypted message cache ───────────────────────────────
+// Keyed by Mongo _id. Stored chats are never modified, so an entry only
+// goes stale when /api/clear deletes its conversation.
+size_t cachedMessageCost(const std::string& id, const Message& m) {
+    return sizeof(Message) + 64 + id.size() + m.id.size() + m.from.size() + m.fromName.size() +
+           m.fromAvatar.size() + m.to.size() + m.toName.size() + m.content.size() + m.chatType.size() +
+           (m.fragment ? m.fragment->size() + 32 : 0);
+}
+
+LruCache<std::string, Message>& messageCache() {
+    static LruCache<std::string, Message> cache((size_t)config.message_cache_mb << 20, cachedMessageCost);
+    return cache;
+}
+
+// Decrypts stored chats, reusing cached plaintext where possible. Bulk
+// readers (exports) pass populateCache=false so they do not evict hot entries.
+std::vector<Message> mongoDecodeMessages(std::vector<Message> docs, bool populateCache = true) {
+    std::vector<Message> misses;
+    std::vector<size_t> missAt;
+    for (size_t i = 0; i < docs.size(); i++) {
+        Message cached;
+        if (messageCache().get(docs[i].id, cached)) {
+            docs[i] = std::move(cached);
+            continue;
+        }
+        missAt.push_back(i);
+        misses.push_back(std::move(docs[i]));
+    }
+
+    decryptMessages(misses);
+    for (size_t i = 0; i < misses.size(); i++) {
+        misses[i].seal();
+        if (populateCache) messageCache().put(misses[i].id, misses[i]);
+        docs[missAt[i]] = std::move(misses[i]);
+    }
+    return docs;
+}
+#endif
+
+// ═══════════════════════════════════════════════════════════
+//  Write-Behind Chat Writer (MongoDB)
+// ═══════════════════════════════════════════════════════════
+
+#ifdef USE_MONGODB
+static const size_t WRITE_QUEUE_CAPACITY = 10000;   // backpressure threshold
+static const size_t WRITE_BATCH_MAX = 256;          // docs per insert_many
+static const int WRITE_FLUSH_WINDOW_MS = 20;        // group-commit window
+static const int WRITE_ENQUEUE_TIMEOUT_MS = 2000;   // max time a sender waits on a full queue
+static const int WRITE_RETRY_MIN_MS = 100;          // first backoff after a failed insert
+static const int WRITE_RETRY_MAX_MS = 10000;        // backoff ceiling
+
+// /api/send acknowledges as soon as a message is queued here; a single
+// background thread encrypts and persists queued messages in batches.
+// Messages are numbered as they are queued, so batches are stored in
+// sequence order and everything up to visibleSeq() is readable. A batch
+// that fails to store is retried with backoff ahead of everything queued
+// after it, and dropped only if it still fails at shutdown.
+class ChatWriter {
+    std::mutex mu_;
+    std::condition_variable notEmpty_, notFull_;
+    std::deque<Message> queue_;
+    bool stopping_ = false;
+    std::thread worker_;
+    std::atomic<uint64_t> written_{0}, failed_{0}, retries_{0};
+    std::atomic<uint64_t> visibleSeq_{0};
+    int64_t lastTs_ = 0;  // newest timestamp handed out, under mu_
+
+    void run() {
+        std::vector<Message> batch;
+        std::vector<std::string> encrypted;
+        std::vector<bson_oid_t> ids;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mu_);
+                notEmpty_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+                if (queue_.empty()) return;  // stopping and fully drained
+                // Group commit: let a burst fill the batch before flushing
+                notEmpty_.wait_for(lock, std::chrono::milliseconds(WRITE_FLUSH_WINDOW_MS),
+                    [&] { return stopping_ || queue_.size() >= WRITE_BATCH_MAX; });
+                size_t n = std::min(queue_.size(), WRITE_BATCH_MAX);
+                // Never split a timestamp between batches: a timestamp-cursor
+                // reader that saw half of it would skip the rest for good
+                int64_t lastTs = 0;
+                for (size_t i = 0; i < n; i++) lastTs = std::max(lastTs, queue_[i].timestamp);
+                while (n < queue_.size() && queue_[n].timestamp <= lastTs) n++;
+                batch.assign(std::make_move_iterator(queue_.begin()),
+                             std::make_move_iterator(queue_.begin() + n));
+                queue_.erase(queue_.begin(), queue_.begin() + n);
+            }
+            notFull_.notify_all();
+
+            encrypted.clear();
+            for (auto& msg : batch) encrypted.push_back(aes_encrypt(msg.content, config.encryption_key));
+            ids.resize(batch.size());
+            for (auto& id : ids) bson_oid_init(&id, NULL);
+
+            // The senders were already acknowledged: keep retrying while
+            // later messages wait behind this batch (senders block once the
+            // queue fills). Stopping allows one last attempt.
+            bool ok = mongoInsertChats(batch, encrypted, ids);
+            for (int delayMs = WRITE_RETRY_MIN_MS; !ok; delayMs = std::min(delayMs * 2, WRITE_RETRY_MAX_MS)) {
+                bool stopping;
+                {
+                    std::unique_lock<std::mutex> lock(mu_);
+                    stopping = notEmpty_.wait_for(lock, std::chrono::milliseconds(delayMs), [&] { return stopping_; });
+                }
+                retries_++;
+                ok = mongoInsertChats(batch, encrypted, ids);
+                if (stopping) break;
+            }
+            // Readers must not wait on a batch dropped at shutdown
+            visibleSeq_ = batch.back().seq;
+            if (!ok) {
+                std::cerr << "❌ Dropped " << batch.size() << " unsaved messages at shutdown" << std::endl;
+                failed_ += batch.size();
+                continue;
+            }
+            written_ += batch.size();
+
+            // Reads come from Mongo, so long-poll waiters wake only once stored
+            std::vector<std::string> keys;
+            for (auto& msg : batch) keys.push_back(conversationKey(msg));
+            std::sort(keys.begin(), keys.end());
+            keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+            for (auto& key : keys) changeNotifier.notify(key);
+        }
+    }
+
+public:
+    // Call once messageSeq holds the highest stored sequence number
+    void start() {
+        visibleSeq_ = messageSeq.load();
+        worker_ = std::thread([this] { run(); });
+    }
+
+    // Stamps, numbers, queues and seals `msg`. Timestamps never go backwards
+    // in seq order (as indexMessage clamps them), so a timestamp cursor never
+    // passes a message stored in a later batch. Blocks while the queue is
+    // full; false if it stayed full past the timeout.
+    bool enqueue(Message& msg) {
+        {
+            std::unique_lock<std::mutex> lock(mu_);
+            if (!notFull_.wait_for(lock, std::chrono::milliseconds(WRITE_ENQUEUE_TIMEOUT_MS),
+                    [&] { return stopping_ || queue_.size() < WRITE_QUEUE_CAPACITY; }))
+                return false;
+            if (stopping_) return false;
+            msg.timestamp = lastTs_ = std::max(nowMs(), lastTs_);
+            msg.seq = ++messageSeq;
+            queue_.push_back(msg);
+        }
+        msg.seal();
+        notEmpty_.notify_one();
+        return true;
+    }
+
+    // Every message numbered at or below this is stored (or dropped at shutdown)
+    uint64_t visibleSeq() const { return visibleSeq_.load(); }
+
+    // Flushes everything still queued, then joins the writer thread
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stopping_ = true;
+        }
+        notEmpty_.notify_all();
+        notFull_.notify_all();
+        if (worker_.joinable()) worker_.join();
+    }
+
+    json stats() {
+        std::lock_guard<std::mutex> lock(mu_);
+        return {{"queued", queue_.size()}, {"written", written_.load()}, {"failed", failed_.load()},
+                {"retries", retries_.load()}, {"visibleSeq", visibleSeq_.load()}};
+    }
+};
+
+static ChatWriter chatWriter;
+
+// ── User directory refresh ────────────────────────────────
+static const int USER_REFRESH_SEC = 60;
+
+// Reloads the user directory from MongoDB in the background, so users
+// written by another process (a previous writer before a handover, admin
+// tooling) appear without a scan per request
+class UserRefresher {
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    std::thread worker_;
+
+public:
+    void start() {
+        worker_ = std::thread([this] {
+            std::unique_lock<std::mutex> lock(mu_);
+            while (!cv_.wait_for(lock, std::chrono::seconds(USER_REFRESH_SEC), [&] { return stopping_; })) {
+                lock.unlock();
+                users.merge(mongoFindUsers());
+                lock.lock();
+            }
+        });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) worker_.join();
+    }
+};
+
+static UserRefresher userRefresher;
+
+// ── Single-writer lease ───────────────────────────────────
+static const int64_t WRITER_LEASE_MS = 30000;
+static const int64_t WRITER_RENEW_MS = 10000;
+
+// Sequence numbers come from chatWriter's in-process counter, and
+// afterSeq readers rely on seqs being stored in order, so only one
+// instance may write chats. It holds a lease document in Mongo, renewed in
+// the background; another instance waits at startup until the lease is
+// released or expires. An instance that cannot renew in time stops
+// accepting sends rather than risk numbering alongside a new writer.
+class WriterLease {
+    std::string owner_;
+    std::atomic<int64_t> expiresAt_{0};   // local clock; 0 = not held
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    std::thread worker_;
+
+    bool claim() {
+        int64_t until = nowMs() + WRITER_LEASE_MS;  // measured from before the request
+        if (!mongoClaimWriterLease(owner_, until)) return false;
+        expiresAt_ = until;
+        return true;
+    }
+
+public:
+    // Blocks until this instance holds the lease
+    void acquire() {
+        bson_oid_t oid;
+        bson_oid_init(&oid, NULL);
+        char hex[25];
+        bson_oid_to_string(&oid, hex);
+        owner_ = hex;
+        bool announced = false;
+        while (!claim()) {
+            if (!announced) std::cout << "⏳ Waiting for the chat writer lease (another instance is writing)" << std::endl;
+            announced = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(WRITER_RENEW_MS / 4));
+        }
+    }
+
+    void start() {
+        worker_ = std::thread([this] {
+            std::unique_lock<std::mutex> lock(mu_);
+            while (!cv_.wait_for(lock, std::chrono::milliseconds(WRITER_RENEW_MS), [&] { return stopping_; })) {
+                lock.unlock();
+                if (!claim() && !held()) std::cerr << "❌ Lost the chat writer lease; sends are refused" << std::endl;
+                lock.lock();
+            }
+        });
+    }
+
+    bool held() const { return nowMs() < expiresAt_.load(); }
+
+    // Call after chatWriter has flushed
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) worker_.join();
+        if (expiresAt_.exchange(0)) mongoReleaseWriterLease(owner_);
+    }
+};
+
+static WriterLease writerLease;
+#endif
+
+// ═══════════════════════════════════════════════════════════
+//  Session Tokens (HS256 sign/verify: crypto.hpp)
+// ═══════════════════════════════════════════════════════════
+
+// ── Verified-token cache ──────────────────────────────────
+// Clients re-send the same 7-day token on every poll. Once a token has
+// been verified, its claims are reused until `exp`, skipping the HMAC,
+// base64url decode and JSON parse. LRU shards (as in crypto.hpp's
+// KeyCache) keep concurrent hits from contending on one lock.
+class JwtCache {
+    static const size_t SHARDS = 16;
+    static const size_t MAX_PER_SHARD = 1024;
+    struct Verified {
+        json claims;
+        int64_t exp;
+    };
+    struct Shard : LruCache<std::string, Verified> {
+        Shard() : LruCache(MAX_PER_SHARD, [](const std::string&, const Verified&) { return (size_t)1; }) {}
+    };
+    Shard shards_[SHARDS];
+
+    Shard& shardFor(const std::string& token) {
+        return shards_[std::hash<std::string>{}(token) % SHARDS];
+    }
+
+public:
+    bool find(const std::string& token, json& claims) {
+        Verified entry;
+        if (!shardFor(token).get(token, entry) || entry.exp < std::time(nullptr)) return false;
+        claims = std::move(entry.claims);
+        return true;
+    }
+
+    // Expired tokens are never hit again, so they age out of the LRU order
+    void put(const std::string& token, const json& claims) {
+        int64_t exp = claims.contains("exp") ? claims["exp"].get<int64_t>() : INT64_MAX;
+        shardFor(token).put(token, {claims, exp});
+    }
+};
+
+static JwtCache jwtCache;
+static const Metrics::Counter jwtCacheHits =
+    metrics.counter("chat_jwt_cache_lookups_total", "Verified-token cache lookups", "result=\"hit\"");
+static const Metrics::Counter jwtCacheMisses =
+    metrics.counter("chat_jwt_cache_lookups_total", "Verified-token cache lookups", "result=\"miss\"");
+
+// ── Auth Middleware ────────────────────────────────────────
+json extractUser(const Request& req) {
+    TracePhase phase("auth");
+    try {
+        std::string auth = req.get_header_value("Authorization");
+        if (auth.size() < 8 || auth.compare(0, 7, "Bearer ") != 0) return nullptr;
+        std::string token = auth.substr(7);
+
+        json claims;
+        if (jwtCache.find(token, claims)) {
+            metrics.add(jwtCacheHits);
+            return claims;
+        }
+        metrics.add(jwtCacheMisses);
+        claims = verify_jwt(token, config.jwt_secret);
+        if (!claims.is_null()) jwtCache.put(token, claims);
+        return claims;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+// ═══════════════════════════════════════════════════════════
+//  Google OAuth Token Verification
+// ═══════════════════════════════════════════════════════════
+
+// ID tokens are RS256 JWTs signed with one of Google's published keys, so
+// they are checked locally against a cached copy of that key set (JWKS).
+// Only a cold or expiring cache touches the network.
+
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+static const char* GOOGLE_JWKS_HOST = "www.googleapis.com";
+static const char* GOOGLE_JWKS_PATH = "/oauth2/v3/certs";
+static const int64_t JWKS_DEFAULT_TTL_SEC = 3600;   // when the response has no max-age
+static const int64_t JWKS_REFRESH_AHEAD_SEC = 300;  // start refreshing this long before expiry
+static const int64_t JWKS_MIN_REFETCH_SEC = 30;     // unknown-kid refetches are rate limited
+static const int64_t TOKEN_CLOCK_SKEW_SEC = 60;
+
+using PKeyPtr = std::shared_ptr<EVP_PKEY>;
+
+// RSA public key from the base64url modulus and exponent of a JWK
+PKeyPtr rsaPublicKey(const std::string& n64, const std::string& e64) {
+    std::string n = base64url_decode(n64), e = base64url_decode(e64);
+    BIGNUM* bn = BN_bin2bn((const unsigned char*)n.data(), (int)n.size(), NULL);
+    BIGNUM* be = BN_bin2bn((const unsigned char*)e.data(), (int)e.size(), NULL);
+    EVP_PKEY* pkey = NULL;
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    OSSL_PARAM_BLD* bld = OSSL_PARAM_BLD_new();
+    OSSL_PARAM* params = NULL;
+    EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_from_name(NULL, "RSA", NULL);
+    if (bld && bn && be && ctx &&
+        OSSL_PARAM_BLD_push_BN(bld, OSSL_PKEY_PARAM_RSA_N, bn) &&
+        OSSL_PARAM_BLD_push_BN(bld, OSSL_PKEY_PARAM_RSA_E, be) &&
+        (params = OSSL_PARAM_BLD_to_param(bld)) &&
+        EVP_PKEY_fromdata_init(ctx) == 1)
+        EVP_PKEY_fromdata(ctx, &pkey, EVP_PKEY_PUBLIC_KEY, params);
+    OSSL_PARAM_free(params);
+    OSSL_PARAM_BLD_free(bld);
+    EVP_PKEY_CTX_free(ctx);
+    BN_free(bn);
+    BN_free(be);
+#else
+    RSA* rsa = RSA_new();
+    if (rsa && bn && be && RSA_set0_key(rsa, bn, be, NULL)) {
+        pkey = EVP_PKEY_new();
+        if (pkey) EVP_PKEY_assign_RSA(pkey, rsa);
+        else RSA_free(rsa);
+    } else {
+        RSA_free(rsa);
+        BN_free(bn);
+        BN_free(be);
+    }
+#endif
+    return pkey ? PKeyPtr(pkey, EVP_PKEY_free) : nullptr;
+}
+
+// Google's signing keys by `kid`. Verifiers share a read lock. A background
+// thread refetches the set ahead of its expiry, so logins never wait on
+// Google for a routine refresh; only an unknown kid or an expired set is
+// fetched on the request thread, one caller at a time.
+class GoogleKeyCache {
+    mutable std::shared_mutex mu_;
+    std::map<std::string, PKeyPtr> keys_;
+    int64_t expiresAt_ = 0;     // unix seconds
+    int64_t lastFetch_ = 0;     // last attempt, successful or not
+    bool pinned_ = false;       // loaded from GOOGLE_JWKS_FILE at startup, never refetched
+    std::mutex refreshMu_;
+
+    std::mutex workerMu_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+    std::thread worker_;
+
+    // Seconds until the background refresh; a failed fetch leaves expiresAt_
+    // behind, so it is retried every JWKS_MIN_REFETCH_SEC
+    int64_t nextRefreshIn() const {
+        std::shared_lock<std::shared_mutex> lock(mu_);
+        return std::max(JWKS_MIN_REFETCH_SEC, expiresAt_ - JWKS_REFRESH_AHEAD_SEC - (int64_t)std::time(nullptr));
+    }
+
+    bool install(const std::string& body, int64_t ttlSec) {
+        json jwks = json::parse(body, nullptr, false);
+        if (jwks.is_discarded() || !jwks.contains("keys") || !jwks["keys"].is_array()) return false;
+        std::map<std::string, PKeyPtr> keys;
+        for (auto& k : jwks["keys"]) {
+            if (!k.is_object() || k.value("kty", "") != "RSA" || !k.contains("kid")) continue;
+            if (PKeyPtr key = rsaPublicKey(k.value("n", ""), k.value("e", ""))) keys[k["kid"]] = key;
+        }
+        if (keys.empty()) return false;
+        std::unique_lock<std::shared_mutex> lock(mu_);
+        keys_.swap(keys);
+        expiresAt_ = std::time(nullptr) + ttlSec;
+        return true;
+    }
+
+    // Caller holds refreshMu_
+    bool fetch() {
+        {
+            std::unique_lock<std::shared_mutex> lock(mu_);
+            lastFetch_ = std::time(nullptr);
+        }
+        httplib::SSLClient cli(GOOGLE_JWKS_HOST);
+        cli.set_connection_timeout(5);
+        cli.set_read_timeout(5);
+        auto res = cli.Get(GOOGLE_JWKS_PATH);
+        if (!res || res->status != 200) {
+            std::cerr << "Google JWKS fetch failed" << std::endl;
+            return false;
+        }
+        int64_t ttl = JWKS_DEFAULT_TTL_SEC;
+        std::string cacheControl = res->get_header_value("Cache-Control");
+        auto pos = cacheControl.find("max-age=");
+        if (pos != std::string::npos) {
+            try { ttl = std::max<int64_t>(60, std::stoll(cacheControl.substr(pos + 8))); } catch (...) {}
+        }
+        return install(res->body, ttl);
+    }
+
+public:
+    bool loadFile(const std::string& path) {
+        std::ifstream file(path);
+        if (!file.is_open()) return false;
+        std::stringstream ss;
+        ss << file.rdbuf();
+        pinned_ = install(ss.str(), INT32_MAX);
+        return pinned_;
+    }
+
+    // Fetches the key set unless it is pinned; used to warm the cache at startup
+    bool refresh() {
+        if (pinned_) return true;
+        std::lock_guard<std::mutex> lock(refreshMu_);
+        return fetch();
+    }
+
+    void start() {
+        if (pinned_) return;
+        worker_ = std::thread([this] {
+            std::unique_lock<std::mutex> lock(workerMu_);
+            while (!cv_.wait_for(lock, std::chrono::seconds(nextRefreshIn()), [&] { return stopping_; })) {
+                lock.unlock();
+                refresh();
+                lock.lock();
+            }
+        });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(workerMu_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) worker_.join();
+    }
+
+    PKeyPtr find(const std::string& kid) {
+        int64_t now = std::time(nullptr);
+        PKeyPtr key;
+        int64_t expiresAt, lastFetch;
+        {
+            std::shared_lock<std::shared_mutex> lock(mu_);
+            auto it = keys_.find(kid);
+            if (it != keys_.end()) key = it->second;
+            expiresAt = expiresAt_;
+            lastFetch = lastFetch_;
+        }
+        if (pinned_ || (key && now < expiresAt)) return key;
+        // Unknown kid (Google rotated keys) or an expired set
+        if (now - lastFetch < JWKS_MIN_REFETCH_SEC) return key;
+        {
+            std::lock_guard<std::mutex> lock(refreshMu_);
+            std::shared_lock<std::shared_mutex> check(mu_);
+            bool refreshedMeanwhile = lastFetch_ != lastFetch;
+            check.unlock();
+            if (!refreshedMeanwhile) fetch();
+        }
+        // A failed refetch leaves the previous keys in place; they stay usable
+        std::shared_lock<std::shared_mutex> lock(mu_);
+        auto it = keys_.find(kid);
+        return it == keys_.end() ? nullptr : it->second;
+    }
+};
+
+static GoogleKeyCache googleKeys;
+#endif
+
+// Claims of a valid Google ID token (email, name, picture, sub, ...) or null
+static const Metrics::Histogram googleVerifyTime =
+    latencyMetric("chat_google_verify_duration_seconds", "Google ID token verification time");
+
+json verifyGoogleToken(const std::string& idToken) {
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+    Metrics::Timer timer(metrics, googleVerifyTime);
+    size_t dot1 = idToken.find('.');
+    size_t dot2 = dot1 == std::string::npos ? dot1 : idToken.find('.', dot1 + 1);
+    if (dot2 == std::string::npos) return nullptr;
+
+    json header = json::parse(base64url_decode(idToken.substr(0, dot1)), nullptr, false);
+    if (!header.is_object() || header.value("alg", "") != "RS256" || !header.contains("kid") ||
+        !header["kid"].is_string())
+        return nullptr;
+    PKeyPtr key = googleKeys.find(header["kid"]);
+    if (!key) return nullptr;
+
+    std::string sig = base64url_decode(idToken.substr(dot2 + 1));
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    bool valid = ctx && EVP_DigestVerifyInit(ctx, NULL, EVP_sha256(), NULL, key.get()) == 1 &&
+                 EVP_DigestVerify(ctx, (const unsigned char*)sig.data(), sig.size(),
+                                  (const unsigned char*)idToken.data(), dot2) == 1;
+    EVP_MD_CTX_free(ctx);
+    if (!valid) return nullptr;
+
+    json claims = json::parse(base64url_decode(idToken.substr(dot1 + 1, dot2 - dot1 - 1)), nullptr, false);
+    if (!claims.is_object() || !claims.contains("email") || !claims["email"].is_string()) return nullptr;
+
+    std::string iss = claims.value("iss", "");
+    if (iss != "accounts.google.com" && iss != "https://accounts.google.com") return nullptr;
+
+    const json& aud = claims.contains("aud") ? claims["aud"] : json();
+    bool audOk = aud.is_string() ? aud == config.google_client_id
+               : aud.is_array() && std::find(aud.begin(), aud.end(), config.google_client_id) != aud.end();
+    if (config.google_client_id.empty() || !audOk) return nullptr;
+
+    if (!claims.contains("exp") || !claims["exp"].is_number() ||
+        claims["exp"].get<int64_t>() + TOKEN_CLOCK_SKEW_SEC < (int64_t)std::time(nullptr))
+        return nullptr;
+    return claims;
+#else
+    (void)idToken;
+    return nullptr;
+#endif
 }
 
 // ═══════════════════════════════════════════════════════════
-//  MongoDB Operations (when USE_MONGODB is defined)
+//  Message Queries
 // ═══════════════════════════════════════════════════════════
 
-#ifdef USE_MONGODB
-static mongoc_client_t* mongoClient = nullptr;
-static bool mongoConnected = false;
-
-bool mongoConnect() {
-    mongoc_init();
-    mongoClient = mongoc_client_new(config.mongodb_uri.c_str());
-    if (!mongoClient) return false;
-    mongoc_client_set_appname(mongoClient, "ChatAppLogger-CPP");
+enum class PageDirection { Older, Newer };
 
-    bson_t* cmd = BCON_NEW("ping", BCON_INT32(1));
-    bson_t reply;
-    bson_error_t err;
-    bool ok = mongoc_client_command_simple(mongoClient, "admin", cmd, NULL, &reply, &err);
-    bson_destroy(cmd);
-    bson_destroy(&reply);
-    if (!ok) {
-        std::cerr << "MongoDB error: " << err.message << std::endl;
-        return false;
-    }
+struct MessagePage {
+    std::vector<Message> messages;  // oldest first
+    bool more = false;              // further messages exist in the paging direction
+};
 
-    // Drop legacy username index if exists
-    mongoc_collection_t* col = mongoc_client_get_collection(mongoClient, "ChatLogger", "Users");
-    mongoc_collection_drop_index(col, "username_1", NULL);
-    mongoc_collection_destroy(col);
+// Up to `limit` messages of one conversation (up to MAX_PAGE_SIZE on a
+// timestamp tie). Older pages end before `cursorTs`, 0 meaning the newest
+// page; newer pages start after it.
+MessagePage fetchMessagePage(const std::string& chatType, const std::string& withUser,
+                             const std::string& email, PageDirection dir, int64_t cursorTs, size_t limit) {
+    MessagePage page;
+    if (chatType != "global" && !(chatType == "private" && !withUser.empty())) return page;
+    limit = std::max<size_t>(1, std::min(limit, MAX_PAGE_SIZE));
 
-    mongoConnected = true;
-    return true;
+#ifdef USE_MONGODB
+    std::vector<Message> docs = mongoFindChatPage(mongoChatQuery(chatType, email, withUser).get(),
+        dir == PageDirection::Older, cursorTs, (int64_t)limit, page.more);
+    page.messages = mongoDecodeMessages(std::move(docs));
+#else
+    std::string key = conversationKey(chatType, email, withUser);
+    if (dir == PageDirection::Newer)
+        page.messages = collectMessagesSince(key, cursorTs, limit, &page.more);
+    else
+        page.messages = collectMessagesBefore(key, cursorTs > 0 ? cursorTs : INT64_MAX, limit, &page.more);
+#endif
+    return page;
 }
 
-json mongoBsonToJson(const bson_t* doc) {
-    char* str = bson_as_canonical_extended_json(doc, NULL);
-    json j = json::parse(str, nullptr, false);
-    bson_free(str);
-    return j;
-}
+// Up to `limit` messages numbered above `afterSeq`, in sequence order.
+// MongoDB reads stop at chatWriter's visible sequence, so a message still
+// queued behind a lower-numbered one is never returned ahead of it.
+MessagePage fetchMessagesAfterSeq(const std::string& chatType, const std::string& withUser,
+                                  const std::string& email, uint64_t afterSeq, size_t limit) {
+    MessagePage page;
+    if (chatType != "global" && !(chatType == "private" && !withUser.empty())) return page;
+    limit = std::max<size_t>(1, std::min(limit, MAX_PAGE_SIZE));
 
-// Safely extract timestamp (ms) from various MongoDB date formats
-int64_t extractTimestamp(const json& d) {
-    try {
-        if (!d.contains("timestamp")) return nowMs();
-        auto& ts = d["timestamp"];
-        // Canonical: {"$date": {"$numberLong": "123456"}}
-        if (ts.contains("$date")) {
-            auto& dt = ts["$date"];
-            if (dt.is_object() && dt.contains("$numberLong"))
-                return std::stoll(dt["$numberLong"].get<std::string>());
-            if (dt.is_string()) return nowMs(); // ISO string, skip parsing
-            if (dt.is_number()) return dt.get<int64_t>();
-        }
-        if (ts.is_number()) return ts.get<int64_t>();
-    } catch (...) {}
-    return nowMs();
-}
-
-// Safely extract string _id from BSON ObjectId or string
-std::string extractId(const json& d) {
-    try {
-        if (!d.contains("_id")) return genId();
-        auto& id = d["_id"];
-        if (id.is_string()) return id.get<std::string>();
-        if (id.is_object() && id.contains("$oid")) return id["$oid"].get<std::string>();
-        return id.dump();
-    } catch (...) {}
-    return genId();
+#ifdef USE_MONGODB
+    if (mongoConnected) {
+        uint64_t visible = chatWriter.visibleSeq();
+        if (visible <= afterSeq) return page;
+        BsonPtr query = mongoChatQuery(chatType, email, withUser);
+        BCON_APPEND(query.get(), "seq", "{", "$gt", BCON_INT64((int64_t)afterSeq),
+                                             "$lte", BCON_INT64((int64_t)visible), "}");
+        std::vector<Message> docs = mongoFindChats(query.get(), (int64_t)limit + 1, 1, "seq");
+        page.more = docs.size() > limit;
+        if (page.more) docs.resize(limit);
+        page.messages = mongoDecodeMessages(std::move(docs));
+        return page;
+    }
+#endif
+    page.messages = collectMessagesAfterSeq(conversationKey(chatType, email, withUser), afterSeq, limit, &page.more);
+    return page;
 }
 
-bson_t* mongoJsonToBson(const std::string& jsonStr) {
-    bson_error_t err;
-    bson_t* doc = bson_new_from_json((const uint8_t*)jsonStr.c_str(), jsonStr.size(), &err);
-    return doc ? doc : bson_new();
+// Sequence number a client may resume `afterSeq` sync from after reading
+// `msgs`. MongoDB caps it at the visible sequence: a page can include part
+// of a batch that is still being inserted.
+uint64_t resumeSeq(const std::vector<Message>& msgs, uint64_t fallback) {
+    uint64_t seq = fallback;
+    for (auto& m : msgs) seq = std::max(seq, m.seq);
+#ifdef USE_MONGODB
+    if (mongoConnected) seq = std::min(seq, std::max(fallback, chatWriter.visibleSeq()));
+#endif
+    return seq;
 }
 
-json mongoUpsertUser(const User& user) {
-    if (!mongoConnected) return {};
-    mongoc_collection_t* col = mongoc_client_get_collection(mongoClient, "ChatLogger", "Users");
-
-    std::string filter = json({{"googleId", user.googleId}}).dump();
-    std::string update = json({{"$set", {
-        {"googleId", user.googleId}, {"email", user.email},
-        {"name", user.name}, {"avatar", user.avatar},
-        {"lastActive", {{"$date", {{"$numberLong", std::to_string(user.lastActive)}}}}}
-    }}, {"$setOnInsert", {
-        {"createdAt", {{"$date", {{"$numberLong", std::to_string(nowMs())}}}}}
-    }}}).dump();
-
-    bson_t* bFilter = mongoJsonToBson(filter);
-    bson_t* bUpdate = mongoJsonToBson(update);
-    bson_t opts;
-    bson_init(&opts);
-    BSON_APPEND_BOOL(&opts, "upsert", true);
-
-    bson_error_t err;
-    mongoc_collection_update_one(col, bFilter, bUpdate, &opts, NULL, &err);
-
-    bson_destroy(bFilter);
-    bson_destroy(bUpdate);
-    bson_destroy(&opts);
-    mongoc_collection_destroy(col);
-    return {};
+// Messages newer than `sinceTs`, oldest first (long-poll)
+std::vector<Message> fetchMessages(const std::string& chatType, const std::string& withUser,
+                                   const std::string& email, int64_t sinceTs) {
+    return fetchMessagePage(chatType, withUser, email, PageDirection::Newer, sinceTs, MAX_PAGE_SIZE).messages;
 }
 
-void mongoInsertChat(const Message& msg, const std::string& encryptedContent) {
-    if (!mongoConnected) return;
-    mongoc_collection_t* col = mongoc_client_get_collection(mongoClient, "ChatLogger", "Chats");
-
-    json doc = {
-        {"from", msg.from}, {"fromName", msg.fromName}, {"fromAvatar", msg.fromAvatar},
-        {"to", msg.to}, {"toName", msg.toName}, {"content", encryptedContent},
-        {"chatType", msg.chatType},
-        {"timestamp", {{"$date", {{"$numberLong", std::to_string(msg.timestamp)}}}}}
-    };
+// ═══════════════════════════════════════════════════════════
+//  Chat Export (streamed /api/download)
+// ═══════════════════════════════════════════════════════════
 
-    bson_t* bDoc = mongoJsonToBson(doc.dump());
-    bson_error_t err;
-    mongoc_collection_insert_one(col, bDoc, NULL, NULL, &err);
-    bson_destroy(bDoc);
-    mongoc_collection_destroy(col);
-}
+static const size_t EXPORT_BATCH = 500;   // messages fetched + decrypted per chunk
 
-std::vector<json> mongoFindChats(const json& query) {
-    if (!mongoConnected) return {};
-    mongoc_collection_t* col = mongoc_client_get_collection(mongoClient, "ChatLogger", "Chats");
+enum class ExportFormat { Txt, Jsonl, Csv };
 
-    bson_t* bQuery = mongoJsonToBson(query.dump());
-    bson_t* bOpts = mongoJsonToBson(R"({"sort": {"timestamp": 1}})");
+// Thread-safe replacement for strftime(localtime(...))
+std::string formatLocalTime(int64_t ms) {
+    time_t t = ms / 1000;
+    struct tm tmv;
+#ifdef _WIN32
+    localtime_s(&tmv, &t);
+#else
+    localtime_r(&t, &tmv);
+#endif
+    char buf[64];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tmv);
+    return buf;
+}
 
-    mongoc_cursor_t* cursor = mongoc_collection_find_with_opts(col, bQuery, bOpts, NULL);
-    const bson_t* doc;
-    std::vector<json> results;
-    while (mongoc_cursor_next(cursor, &doc)) {
-        results.push_back(mongoBsonToJson(doc));
+std::string csvField(const std::string& v) {
+    if (v.find_first_of(",\"\r\n") == std::string::npos) return v;
+    std::string out = "\"";
+    for (char c : v) {
+        if (c == '"') out += '"';
+        out += c;
     }
+    return out + "\"";
+}
 
-    mongoc_cursor_destroy(cursor);
-    bson_destroy(bQuery);
-    bson_destroy(bOpts);
-    mongoc_collection_destroy(col);
-    return results;
+std::string exportHeader(ExportFormat format, const std::string& title) {
+    switch (format) {
+    case ExportFormat::Csv:
+        return "timestamp,time,from,fromName,to,content\n";
+    case ExportFormat::Jsonl:
+        return "";
+    default:
+        return std::string(50, '=') + "\n  ChatApp Logger — " + title +
+               "\n  Encryption: AES-256 (decrypted for download)\n" + std::string(50, '=') + "\n\n";
+    }
 }
 
-void mongoDeleteChats(const json& query) {
-    if (!mongoConnected) return;
-    mongoc_collection_t* col = mongoc_client_get_collection(mongoClient, "ChatLogger", "Chats");
-    bson_t* bQuery = mongoJsonToBson(query.dump());
-    bson_error_t err;
-    mongoc_collection_delete_many(col, bQuery, NULL, NULL, &err);
-    bson_destroy(bQuery);
-    mongoc_collection_destroy(col);
+std::string exportFooter(ExportFormat format) {
+    if (format != ExportFormat::Txt) return "";
+    return std::string(50, '=') + "\n  End of Chat Log\n" + std::string(50, '=') + "\n";
 }
 
-std::vector<json> mongoFindUsers() {
-    if (!mongoConnected) return {};
-    mongoc_collection_t* col = mongoc_client_get_collection(mongoClient, "ChatLogger", "Users");
-    bson_t* bQuery = bson_new();
-    mongoc_cursor_t* cursor = mongoc_collection_find_with_opts(col, bQuery, NULL, NULL);
-    const bson_t* doc;
-    std::vector<json> results;
-    while (mongoc_cursor_next(cursor, &doc)) {
-        results.push_back(mongoBsonToJson(doc));
+void appendExportLine(std::string& out, const Message& msg, ExportFormat format) {
+    switch (format) {
+    case ExportFormat::Csv:
+        out += std::to_string(msg.timestamp) + "," + formatLocalTime(msg.timestamp) + "," +
+               csvField(msg.from) + "," + csvField(msg.fromName) + "," + csvField(msg.to) + "," +
+               csvField(msg.content) + "\n";
+        break;
+    case ExportFormat::Jsonl:
+        msg.appendJson(out);
+        out += '\n';
+        break;
+    default:
+        out += "[" + formatLocalTime(msg.timestamp) + "] " + msg.fromName + ":\n  " + msg.content + "\n\n";
     }
-    mongoc_cursor_destroy(cursor);
-    bson_destroy(bQuery);
-    mongoc_collection_destroy(col);
-    return results;
 }
-#endif // USE_MONGODB
 
-// ═══════════════════════════════════════════════════════════
-//  Base64 Encoding / Decoding
-// ═══════════════════════════════════════════════════════════
-
-static const std::string B64_CHARS =
-    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+// Pull-based source for one conversation; each call yields the next batch
+// (empty when done). Local mode copies a batch under the conversation's read
+// lock and releases it, so senders are blocked for at most one batch copy.
+// MongoDB mode runs one range query per batch, resuming after the last
+// document sent, so no pooled client is held while the client downloads.
+class ExportSource {
+    std::string key_;
+    uint64_t afterSeq_ = 0;             // the in-memory history is seq-ordered; ties never split
+    bool done_ = false;
+#ifdef USE_MONGODB
+    BsonPtr conversation_{nullptr, bson_destroy};
+    std::unique_ptr<Message> last_;     // resume point of the next Mongo batch
+#endif
 
-std::string base64_encode(const std::string& in) {
-    std::string out;
-    int val = 0, valb = -6;
-    for (unsigned char c : in) {
-        val = (val << 8) + c;
-        valb += 8;
-        while (valb >= 0) {
-            out.push_back(B64_CHARS[(val >> valb) & 0x3F]);
-            valb -= 6;
-        }
+public:
+    ExportSource(const std::string& chatType, const std::string& email, const std::string& withUser)
+        : key_(conversationKey(chatType, email, withUser)) {
+        done_ = chatType != "global" && chatType != "private";
+#ifdef USE_MONGODB
+        if (!done_ && mongoConnected) conversation_ = mongoChatQuery(chatType, email, withUser);
+#endif
     }
-    if (valb > -6) out.push_back(B64_CHARS[((val << 8) >> (valb + 8)) & 0x3F]);
-    while (out.size() % 4) out.push_back('=');
-    return out;
-}
 
-std::string base64_decode(const std::string& in) {
-    std::vector<int> T(256, -1);
-    for (int i = 0; i < 64; i++) T[B64_CHARS[i]] = i;
-    std::string out;
-    int val = 0, valb = -8;
-    for (unsigned char c : in) {
-        if (T[c] == -1) break;
-        val = (val << 6) + T[c];
-        valb += 6;
-        if (valb >= 0) {
-            out.push_back(char((val >> valb) & 0xFF));
-            valb -= 8;
+    std::vector<Message> nextBatch() {
+        if (done_) return {};
+        std::vector<Message> batch;
+#ifdef USE_MONGODB
+        if (conversation_) {
+            std::vector<Message> docs = mongoFindChatsAfter(conversation_.get(), last_.get(), EXPORT_BATCH);
+            if (!docs.empty()) last_.reset(new Message(docs.back()));
+            batch = mongoDecodeMessages(std::move(docs), false);
+            done_ = batch.empty();
+            return batch;
         }
+#endif
+        batch = collectMessagesAfterSeq(key_, afterSeq_, EXPORT_BATCH);
+        if (batch.empty()) done_ = true;
+        else afterSeq_ = batch.back().seq;
+        return batch;
     }
-    return out;
-}
 
-std::string base64url_encode(const std::string& data) {
-    std::string b = base64_encode(data);
-    for (auto& c : b) { if (c == '+') c = '-'; else if (c == '/') c = '_'; }
-    b.erase(std::remove(b.begin(), b.end(), '='), b.end());
-    return b;
-}
-
-std::string base64url_decode(const std::string& data) {
-    std::string b = data;
-    for (auto& c : b) { if (c == '-') c = '+'; else if (c == '_') c = '/'; }
-    while (b.size() % 4) b += '=';
-    return base64_decode(b);
-}
+    bool done() const { return done_; }
+};
 
 // ═══════════════════════════════════════════════════════════
-//  AES-256 Encryption (OpenSSL, CryptoJS compatible)
+//  Static Asset Cache (public/ served from memory)
 // ═══════════════════════════════════════════════════════════
 
-#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
-std::string aes_encrypt(const std::string& plaintext, const std::string& passphrase) {
-    unsigned char salt[8];
-    RAND_bytes(salt, 8);
-
-    unsigned char key[32], iv[16];
-    EVP_BytesToKey(EVP_aes_256_cbc(), EVP_md5(), salt,
-                   (const unsigned char*)passphrase.c_str(), passphrase.size(), 1, key, iv);
+static const char* PUBLIC_DIR = "./public";
+static const int STATIC_WATCH_INTERVAL_MS = 1000;
+static const size_t STATIC_MIN_COMPRESS = 256;   // smaller files are sent as-is
 
-    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-    EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv);
+struct StaticAsset {
+    std::string contentType;
+    std::string body;
+    std::string gzip, brotli;   // empty when not built in or not smaller
+    std::string hash;           // FNV-1a of body; ETag and ?v= cache-buster
+};
 
-    std::vector<unsigned char> ct(plaintext.size() + 32);
-    int len = 0, total = 0;
-    EVP_EncryptUpdate(ctx, ct.data(), &len, (const unsigned char*)plaintext.c_str(), plaintext.size());
-    total = len;
-    EVP_EncryptFinal_ex(ctx, ct.data() + len, &len);
-    total += len;
-    EVP_CIPHER_CTX_free(ctx);
+using AssetMap = std::map<std::string, std::shared_ptr<const StaticAsset>>;  // URL path -> asset
 
-    std::string raw = "Salted__";
-    raw.append((char*)salt, 8);
-    raw.append((char*)ct.data(), total);
-    return base64_encode(raw);
+std::string assetContentType(const std::string& ext) {
+    static const std::map<std::string, std::string> types = {
+        {".html", "text/html; charset=utf-8"}, {".css", "text/css; charset=utf-8"},
+        {".js", "application/javascript; charset=utf-8"}, {".json", "application/json"},
+        {".svg", "image/svg+xml"}, {".png", "image/png"}, {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"}, {".gif", "image/gif"}, {".webp", "image/webp"},
+        {".ico", "image/x-icon"}, {".txt", "text/plain; charset=utf-8"}, {".map", "application/json"},
+        {".woff2", "font/woff2"}
+    };
+    auto it = types.find(ext);
+    return it == types.end() ? "application/octet-stream" : it->second;
 }
 
-std::string aes_decrypt(const std::string& encoded, const std::string& passphrase) {
-    try {
-        std::string raw = base64_decode(encoded);
-        if (raw.size() < 16 || raw.substr(0, 8) != "Salted__") return "[decryption failed]";
-
-        unsigned char salt[8];
-        memcpy(salt, raw.c_str() + 8, 8);
-
-        unsigned char key[32], iv[16];
-        EVP_BytesToKey(EVP_aes_256_cbc(), EVP_md5(), salt,
-                       (const unsigned char*)passphrase.c_str(), passphrase.size(), 1, key, iv);
-
-        std::string ct = raw.substr(16);
-        EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
-        EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv);
-
-        std::vector<unsigned char> pt(ct.size() + 32);
-        int len = 0, total = 0;
-        EVP_DecryptUpdate(ctx, pt.data(), &len, (const unsigned char*)ct.c_str(), ct.size());
-        total = len;
-        EVP_DecryptFinal_ex(ctx, pt.data() + len, &len);
-        total += len;
-        EVP_CIPHER_CTX_free(ctx);
-        return std::string((char*)pt.data(), total);
-    } catch (...) {
-        return "[decryption failed]";
+// Appends ?v=<hash> to local href/src references in HTML, so the assets
+// they name can be cached for a year and still change on the next deploy
+std::string versionAssetLinks(const std::string& html, const AssetMap& assets) {
+    std::string out;
+    out.reserve(html.size() + 256);
+    size_t pos = 0;
+    while (pos < html.size()) {
+        size_t href = html.find("href=\"", pos), src = html.find("src=\"", pos);
+        size_t at = std::min(href, src);
+        if (at == std::string::npos) break;
+        size_t start = at + (at == href ? 6 : 5);
+        size_t end = html.find('"', start);
+        if (end == std::string::npos) break;
+        out.append(html, pos, end - pos);
+        std::string ref = html.substr(start, end - start);
+        auto it = assets.find(ref.empty() || ref[0] == '/' ? ref : "/" + ref);
+        if (!ref.empty() && ref.find("//") == std::string::npos && ref.find('?') == std::string::npos &&
+            it != assets.end())
+            out += "?v=" + it->second->hash;
+        pos = end;
     }
+    out.append(html, pos, std::string::npos);
+    return out;
 }
-#else
-// Fallback: no encryption
-std::string aes_encrypt(const std::string& plaintext, const std::string&) { return base64_encode(plaintext); }
-std::string aes_decrypt(const std::string& encoded, const std::string&) { return base64_decode(encoded); }
-#endif
 
-// ═══════════════════════════════════════════════════════════
-//  JWT (HS256) — Create & Verify
-// ═══════════════════════════════════════════════════════════
+// Everything under public/ is read, compressed and hashed once; requests
+// never touch the disk. With STATIC_RELOAD=1 a watcher rebuilds the set
+// when a file changes, and readers swap to it atomically.
+class StaticAssetCache {
+    std::shared_ptr<const AssetMap> assets_;
+    std::string dir_;
+    std::map<std::string, std::filesystem::file_time_type> mtimes_;
+    std::mutex watchMu_;
+    std::condition_variable watchCv_;
+    bool stopping_ = false;
+    std::thread watcher_;
+
+    static std::shared_ptr<StaticAsset> prepare(const std::string& contentType, std::string body) {
+        auto asset = std::make_shared<StaticAsset>();
+        asset->contentType = contentType;
+        asset->body = std::move(body);
+        asset->hash = contentHash(asset->body);
+        bool compressible = contentType.rfind("text/", 0) == 0 || contentType.find("javascript") != std::string::npos ||
+                            contentType.find("json") != std::string::npos || contentType.find("svg") != std::string::npos;
+        if (compressible && asset->body.size() >= STATIC_MIN_COMPRESS) {
+            asset->gzip = gzipCompress(asset->body);
+            asset->brotli = brotliCompress(asset->body);
+            // Keep a variant only when it actually saves bytes
+            if (asset->gzip.size() * 10 >= asset->body.size() * 9) asset->gzip.clear();
+            if (asset->brotli.size() * 10 >= asset->body.size() * 9) asset->brotli.clear();
+        }
+        return asset;
+    }
 
-std::string jwt_sign(const std::string& input, const std::string& secret) {
-#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
-    unsigned char hmac[EVP_MAX_MD_SIZE];
-    unsigned int hmacLen;
-    HMAC(EVP_sha256(), secret.c_str(), secret.size(),
-         (unsigned char*)input.c_str(), input.size(), hmac, &hmacLen);
-    return base64url_encode(std::string((char*)hmac, hmacLen));
-#else
-    // Simple hash fallback (NOT secure, for local dev only)
-    size_t h = std::hash<std::string>{}(input + secret);
-    return base64url_encode(std::to_string(h));
-#endif
-}
+    std::map<std::string, std::filesystem::file_time_type> scan(std::vector<std::filesystem::path>* files) const {
+        std::map<std::string, std::filesystem::file_time_type> mtimes;
+        std::error_code ec;
+        for (auto it = std::filesystem::recursive_directory_iterator(dir_, ec);
+             !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+            if (!it->is_regular_file(ec)) continue;
+            mtimes[it->path().string()] = it->last_write_time(ec);
+            if (files) files->push_back(it->path());
+        }
+        return mtimes;
+    }
 
-std::string create_jwt(const json& payload, const std::string& secret) {
-    json header = {{"alg", "HS256"}, {"typ", "JWT"}};
-    std::string h = base64url_encode(header.dump());
-    std::string p = base64url_encode(payload.dump());
-    std::string sig = jwt_sign(h + "." + p, secret);
-    return h + "." + p + "." + sig;
-}
+public:
+    // Loads (or reloads) every file; HTML goes last so it can version links
+    size_t load(const std::string& dir) {
+        dir_ = dir;
+        std::vector<std::filesystem::path> files;
+        mtimes_ = scan(&files);
+        auto assets = std::make_shared<AssetMap>();
+        std::vector<std::pair<std::string, std::string>> html;
+        for (auto& path : files) {
+            std::ifstream f(path, std::ios::binary);
+            if (!f.is_open()) continue;
+            std::string body((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+            std::string url = "/" + std::filesystem::relative(path, dir_).generic_string();
+            std::string ext = path.extension().string();
+            if (ext == ".html") html.emplace_back(url, std::move(body));
+            else (*assets)[url] = prepare(assetContentType(ext), std::move(body));
+        }
+        for (auto& [url, body] : html)
+            (*assets)[url] = prepare(assetContentType(".html"), versionAssetLinks(body, *assets));
+        std::atomic_store(&assets_, std::shared_ptr<const AssetMap>(assets));
+        return assets->size();
+    }
+
+    std::shared_ptr<const StaticAsset> find(const std::string& path) const {
+        auto assets = std::atomic_load(&assets_);
+        if (!assets) return nullptr;
+        auto it = assets->find(path == "/" ? "/index.html" : path);
+        return it == assets->end() ? nullptr : it->second;
+    }
 
-json verify_jwt(const std::string& token, const std::string& secret) {
-    auto d1 = token.find('.');
-    auto d2 = token.find('.', d1 + 1);
-    if (d1 == std::string::npos || d2 == std::string::npos) return nullptr;
+    // Polls modification times (portable; no inotify) and reloads on change
+    void startWatching() {
+        watcher_ = std::thread([this] {
+            std::unique_lock<std::mutex> lock(watchMu_);
+            while (!watchCv_.wait_for(lock, std::chrono::milliseconds(STATIC_WATCH_INTERVAL_MS),
+                                      [&] { return stopping_; })) {
+                if (scan(nullptr) == mtimes_) continue;
+                size_t n = load(dir_);
+                std::cout << "♻️  Reloaded " << n << " static files" << std::endl;
+            }
+        });
+    }
 
-    std::string sigInput = token.substr(0, d2);
-    std::string sig = token.substr(d2 + 1);
-    if (jwt_sign(sigInput, secret) != sig) return nullptr;
+    void stopWatching() {
+        {
+            std::lock_guard<std::mutex> lock(watchMu_);
+            stopping_ = true;
+        }
+        watchCv_.notify_all();
+        if (watcher_.joinable()) watcher_.join();
+    }
+};
 
-    std::string payloadStr = base64url_decode(token.substr(d1 + 1, d2 - d1 - 1));
-    json payload = json::parse(payloadStr, nullptr, false);
-    if (payload.is_discarded()) return nullptr;
+static StaticAssetCache staticAssets;
+
+// True when an If-None-Match header lists `etag` (weak comparison, or `*`)
+bool etagMatches(const std::string& header, const std::string& etag) {
+    if (header.empty()) return false;
+    if (header == "*") return true;
+    size_t pos = 0;
+    while (pos < header.size()) {
+        size_t end = header.find(',', pos);
+        if (end == std::string::npos) end = header.size();
+        std::string tag = header.substr(pos, end - pos);
+        pos = end + 1;
+        tag.erase(0, tag.find_first_not_of(" \t"));
+        tag.erase(tag.find_last_not_of(" \t") + 1);
+        if (tag.rfind("W/", 0) == 0) tag.erase(0, 2);
+        if (tag == etag) return true;
+    }
+    return false;
+}
 
-    if (payload.contains("exp") && payload["exp"].get<int64_t>() < std::time(nullptr))
-        return nullptr;
+// Sends `asset` in the best encoding the client accepts, or a 304. Bodies are
+// streamed straight from the cached strings; the provider holds the asset
+// alive across a concurrent reload.
+void sendStaticAsset(const Request& req, Response& res, std::shared_ptr<const StaticAsset> asset) {
+    std::string accept = req.get_header_value("Accept-Encoding");
+    const std::string* body = &asset->body;
+    ContentEncoding encoding = ContentEncoding::Identity;
+    if (!asset->brotli.empty() && acceptsEncoding(accept, "br")) {
+        body = &asset->brotli;
+        encoding = ContentEncoding::Brotli;
+    } else if (!asset->gzip.empty() && acceptsEncoding(accept, "gzip")) {
+        body = &asset->gzip;
+        encoding = ContentEncoding::Gzip;
+    }
 
-    return payload;
+    // One strong ETag per representation
+    std::string etag = "\"" + asset->hash +
+        (encoding == ContentEncoding::Identity ? "" : std::string("-") + encodingName(encoding)) + "\"";
+    res.set_header("ETag", etag);
+    if (!asset->gzip.empty() || !asset->brotli.empty()) res.set_header("Vary", "Accept-Encoding");
+    // Links versioned by index.html are immutable; everything else revalidates
+    bool versioned = req.get_param_value("v") == asset->hash;
+    res.set_header("Cache-Control", versioned ? "public, max-age=31536000, immutable" : "no-cache");
+
+    if (etagMatches(req.get_header_value("If-None-Match"), etag)) {
+        res.status = 304;
+        return;
+    }
+    res.status = 200;
+    if (encoding != ContentEncoding::Identity) res.set_header("Content-Encoding", encodingName(encoding));
+    res.set_content_provider(body->size(), asset->contentType,
+        [asset, body](size_t offset, size_t length, DataSink& sink) {
+            return sink.write(body->data() + offset, length);
+        });
 }
 
-// ── Auth Middleware ────────────────────────────────────────
-json extractUser(const Request& req) {
-    try {
-        std::string auth = req.get_header_value("Authorization");
-        if (auth.size() < 8 || auth.substr(0, 7) != "Bearer ") return nullptr;
-        return verify_jwt(auth.substr(7), config.jwt_secret);
-    } catch (...) {
-        return nullptr;
+// ── API responses ─────────────────────────────────────────
+static const size_t API_COMPRESS_MIN = 1024;   // below this, headers outweigh savings
+
+// Sends JSON compressed (zstd or gzip) when large enough and accepted
+void sendJson(const Request& req, Response& res, std::string body) {
+    res.set_header("Vary", "Accept-Encoding");
+    if (body.size() >= API_COMPRESS_MIN) {
+        TracePhase phase("compress");
+        ContentEncoding encoding = negotiateDynamic(req.get_header_value("Accept-Encoding"));
+        std::string packed = compressDynamic(encoding, body);
+        if (!packed.empty() && packed.size() < body.size()) {
+            res.set_header("Content-Encoding", encodingName(encoding));
+            body = std::move(packed);
+        }
     }
+    res.set_content(std::move(body), "application/json");
 }
 
-// ═══════════════════════════════════════════════════════════
-//  Google OAuth Token Verification
-// ═══════════════════════════════════════════════════════════
+// Sets the validator and answers 304 when the client already has it. The
+// body depends on who asks, so caches (a browser shared by two accounts
+// included) must key it on the Authorization header too.
+bool notModified(const Request& req, Response& res, const std::string& etag) {
+    res.set_header("ETag", etag);
+    res.set_header("Cache-Control", "private, no-cache");
+    res.set_header("Vary", "Authorization");
+    if (!etagMatches(req.get_header_value("If-None-Match"), etag)) return false;
+    res.status = 304;
+    return true;
+}
 
-json verifyGoogleToken(const std::string& idToken) {
-#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
-    httplib::SSLClient cli("oauth2.googleapis.com");
-    cli.set_connection_timeout(5);
-    auto res = cli.Get(("/tokeninfo?id_token=" + idToken).c_str());
-    if (res && res->status == 200) {
-        json data = json::parse(res->body, nullptr, false);
-        if (!data.is_discarded() && data.contains("email")) {
-            return data;
+// ── Request trace output ──────────────────────────────────
+// Server-Timing durations are in milliseconds. The slow-request line is one
+// JSON object per request so it can be grepped or shipped as-is.
+void reportTrace(const Request& req, Response& res, const RequestTrace& trace,
+                 std::chrono::steady_clock::duration elapsed) {
+    double totalMs = std::chrono::duration<double, std::milli>(elapsed).count();
+    char dur[32];
+    if (config.server_timing) {
+        std::string header;
+        for (size_t i = 0; i < trace.size; i++) {
+            snprintf(dur, sizeof(dur), ";dur=%.3f", trace.phases[i].ns / 1e6);
+            header += std::string(trace.phases[i].name) + dur + ", ";
         }
+        snprintf(dur, sizeof(dur), ";dur=%.3f", totalMs);
+        res.set_header("Server-Timing", header + "total" + dur);
+    }
+    double activeMs = totalMs - trace.ns("wait") / 1e6;
+    if (config.slow_request_ms > 0 && activeMs >= config.slow_request_ms) {
+        json phases = json::object();
+        for (size_t i = 0; i < trace.size; i++)
+            phases[trace.phases[i].name] = {{"ms", trace.phases[i].ns / 1e6}, {"count", trace.phases[i].count}};
+        std::cerr << json({{"slowRequest", {
+            {"method", req.method}, {"path", req.path}, {"status", res.status},
+            {"ms", totalMs}, {"phases", phases}
+        }}}).dump() << std::endl;
     }
-#endif
-    return nullptr;
 }
 
 // ═══════════════════════════════════════════════════════════
 //  MAIN — HTTP Server & Routes
 // ═══════════════════════════════════════════════════════════
 
+// SIGINT/SIGTERM stop the listener so main() can flush pending writes
+static Server* activeServer = nullptr;
+static volatile std::sig_atomic_t shutdownRequested = 0;
+
+void handleShutdownSignal(int) {
+    shutdownRequested = 1;
+    if (activeServer) activeServer->stop();
+}
+
 int main() {
     // Disable stdout/stderr buffering for Docker (Render needs to see logs)
     std::cout << std::unitbuf;
@@ -513,10 +2289,58 @@ int main() {
               << " Google=" << (!config.google_client_id.empty() ? "configured" : "not set")
               << std::endl;
 
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+    // Warm the Google signing-key cache so the first login does not wait on it
+    if (!config.google_jwks_file.empty()) {
+        if (googleKeys.loadFile(config.google_jwks_file))
+            std::cout << "🔑 Google signing keys pinned from " << config.google_jwks_file << std::endl;
+        else
+            std::cerr << "❌ Cannot load Google signing keys from " << config.google_jwks_file << std::endl;
+    } else if (!config.google_client_id.empty()) {
+        if (googleKeys.refresh()) std::cout << "🔑 Google signing keys cached" << std::endl;
+        googleKeys.start();
+    }
+#endif
+
     Server svr;
 
-    // ── CORS & Headers (post-routing) ─────────────────────
-    svr.set_post_routing_handler([](const Request&, Response& res) {
+    // httplib serves each connection on a pool thread; parked long-polls
+    // sleep on a condition variable, so size the pool for idle clients
+    svr.new_task_queue = [] { return new ThreadPool(config.http_threads); };
+
+    // ── Request metrics (pre-routing) ─────────────────────
+    // httplib runs a request's pre- and post-routing handlers on the same
+    // thread, so the start time can live in a thread_local
+    static thread_local std::chrono::steady_clock::time_point requestStart;
+    static thread_local bool requestOpen = false;
+    static thread_local RequestTrace trace;
+    static const bool tracing = config.server_timing || config.slow_request_ms > 0;
+    svr.set_pre_routing_handler([](const Request&, Response&) {
+        requestStart = std::chrono::steady_clock::now();
+        requestOpen = true;
+        metrics.add(httpInFlight);
+        if (tracing) {
+            trace.size = 0;
+            activeTrace = &trace;
+        }
+        return Server::HandlerResponse::Unhandled;
+    });
+
+    // ── CORS, Headers & request metrics (post-routing) ────
+    svr.set_post_routing_handler([](const Request& req, Response& res) {
+        if (requestOpen) {
+            requestOpen = false;
+            auto elapsed = std::chrono::steady_clock::now() - requestStart;
+            metrics.sub(httpInFlight);
+            RouteMetrics& route = routeMetrics(req.path);
+            metrics.observe(route.latency, elapsed);
+            int cls = res.status / 100;
+            if (cls >= 1 && cls <= 5) metrics.add(route.byClass[cls - 1]);
+            if (activeTrace) {
+                activeTrace = nullptr;
+                reportTrace(req, res, trace, elapsed);
+            }
+        }
         res.set_header("Access-Control-Allow-Origin", "*");
         res.set_header("Access-Control-Allow-Headers", "Content-Type, Authorization");
         res.set_header("Access-Control-Allow-Methods", "GET, POST, OPTIONS, DELETE");
@@ -531,8 +2355,10 @@ int main() {
         res.status = 204;
     });
 
-    // ── Serve static files from public/ ───────────────────
-    svr.set_mount_point("/", "./public");
+    // ── Static files (public/, cached in memory) ──────────
+    size_t staticCount = staticAssets.load(PUBLIC_DIR);
+    std::cout << "📁 Cached " << staticCount << " static files from " << PUBLIC_DIR << std::endl;
+    if (config.static_reload) staticAssets.startWatching();
 
     // ═══════ API ROUTES ═══════════════════════════════════
 
@@ -568,10 +2394,13 @@ int main() {
         std::string sub = gUser.value("sub", "");
 
         User user{sub, email, name, avatar, nowMs()};
-        {
-            std::lock_guard<std::mutex> lock(dataMutex);
-            users[email] = user;
-        }
+#ifdef USE_MONGODB
+        users.upsert(user);
+#else
+        uint64_t lsn = 0;
+        users.upsert(user, [&](const User& u) { logUser(u, lsn); });
+        logSync(lsn);
+#endif
 
 #ifdef USE_MONGODB
         mongoUpsertUser(user);
@@ -601,10 +2430,13 @@ int main() {
         std::string email = username + "@local";
 
         User user{"local_" + username, email, username, "", nowMs()};
-        {
-            std::lock_guard<std::mutex> lock(dataMutex);
-            users[email] = user;
-        }
+#ifdef USE_MONGODB
+        users.upsert(user);
+#else
+        uint64_t lsn = 0;
+        users.upsert(user, [&](const User& u) { logUser(u, lsn); });
+        logSync(lsn);
+#endif
 #ifdef USE_MONGODB
         mongoUpsertUser(user);
 #endif
@@ -627,22 +2459,10 @@ int main() {
         json user = extractUser(req);
         if (user.is_null()) { res.status = 401; res.set_content(R"({"error":"Unauthorized"})", "application/json"); return; }
 
-        json userList = json::array();
-#ifdef USE_MONGODB
-        auto dbUsers = mongoFindUsers();
-        for (auto& u : dbUsers) {
-            userList.push_back({
-                {"email", u.value("email", "")}, {"name", u.value("name", "")},
-                {"avatar", u.value("avatar", "")}
-            });
-        }
-#else
-        std::lock_guard<std::mutex> lock(dataMutex);
-        for (auto& [email, u] : users) {
-            userList.push_back({{"email", u.email}, {"name", u.name}, {"avatar", u.avatar}});
-        }
-#endif
-        res.set_content(json({{"users", userList}}).dump(), "application/json");
+        // Served from the in-process directory; clients revalidate with the ETag
+        UserDirectory::Listing listing = users.listing();
+        if (notModified(req, res, listing.etag)) return;
+        sendJson(req, res, *listing.body);
       } catch (const std::exception& e) {
         std::cerr << "GET /api/users error: " << e.what() << std::endl;
         res.status = 500;
@@ -659,55 +2479,74 @@ int main() {
         std::string chatType = req.get_param_value("chatType");
         if (chatType.empty()) chatType = "global";
         std::string withUser = req.get_param_value("with");
-        std::string since = req.get_param_value("since");
         std::string email = user["email"];
-        int64_t sinceTs = 0;
-        try { if (!since.empty()) sinceTs = std::stoll(since); } catch (...) {}
 
-        json messages = json::array();
+        // Every page is a function of the URL and the conversation version,
+        // so an unchanged conversation is answered without fetching
+        if (notModified(req, res, changeNotifier.etag(conversationKey(chatType, email, withUser)))) return;
 
-#ifdef USE_MONGODB
-        json query;
-        if (chatType == "global") {
-            query = {{"chatType", "global"}};
-        } else if (chatType == "private" && !withUser.empty()) {
-            query = {{"chatType", "private"}, {"$or", {{{{"from", email}, {"to", withUser}}, {{"from", withUser}, {"to", email}}}}}};
-        }
-        // Note: timestamp filtering with $gt and $date is complex in extended JSON.
-        // We filter client-side for simplicity and reliability.
-        auto docs = mongoFindChats(query);
-        for (auto& d : docs) {
+        // Delta sync: everything numbered above `afterSeq`, exactly once
+        if (req.has_param("afterSeq")) {
+            uint64_t afterSeq = 0;
+            size_t limit = MAX_PAGE_SIZE;
             try {
-                int64_t ts = extractTimestamp(d);
-                if (sinceTs > 0 && ts <= sinceTs) continue;
-                std::string content = d.value("content", "");
-                messages.push_back({
-                    {"_id", extractId(d)},
-                    {"from", d.value("from", "")}, {"fromName", d.value("fromName", "")},
-                    {"fromAvatar", d.value("fromAvatar", "")}, {"to", d.value("to", "")},
-                    {"toName", d.value("toName", "")},
-                    {"content", aes_decrypt(content, config.encryption_key)},
-                    {"chatType", d.value("chatType", "global")},
-                    {"timestamp", ts}
-                });
-            } catch (const std::exception& e) {
-                std::cerr << "Skipping bad message doc: " << e.what() << std::endl;
+                afterSeq = std::stoull(req.get_param_value("afterSeq"));
+                if (req.has_param("limit")) limit = (size_t)std::max(1LL, std::stoll(req.get_param_value("limit")));
+            } catch (...) {
+                res.status = 400;
+                res.set_content(R"({"error":"Invalid afterSeq or limit"})", "application/json");
+                return;
             }
+            MessagePage page = fetchMessagesAfterSeq(chatType, withUser, email, afterSeq, limit);
+            std::string body = "{\"messages\":";
+            appendMessageArray(body, page.messages);
+            body += ",\"lastSeq\":" + std::to_string(resumeSeq(page.messages, afterSeq)) +
+                    ",\"hasMore\":" + (page.more ? "true" : "false") + "}";
+            sendJson(req, res, std::move(body));
+            return;
         }
-#else
-        std::lock_guard<std::mutex> lock(dataMutex);
-        for (auto& msg : allMessages) {
-            if (msg.timestamp <= sinceTs) continue;
-            bool match = false;
-            if (chatType == "global" && msg.chatType == "global") match = true;
-            if (chatType == "private" && !withUser.empty()) {
-                if ((msg.from == email && msg.to == withUser) || (msg.from == withUser && msg.to == email))
-                    match = true;
-            }
-            if (match) messages.push_back(msg.toJson());
+
+        // `after` (alias: `since`) pages forward, `before` pages back; with
+        // neither, the newest page is returned
+        std::string before = req.get_param_value("before");
+        std::string after = req.has_param("after") ? req.get_param_value("after") : req.get_param_value("since");
+        if (!before.empty() && !after.empty()) {
+            res.status = 400;
+            res.set_content(R"({"error":"Use either before or after, not both"})", "application/json");
+            return;
         }
-#endif
-        res.set_content(json({{"messages", messages}}).dump(), "application/json");
+        PageDirection dir = after.empty() ? PageDirection::Older : PageDirection::Newer;
+        int64_t cursorTs = 0;
+        size_t limit = after.empty() ? DEFAULT_PAGE_SIZE : MAX_PAGE_SIZE;
+        try {
+            if (!before.empty()) cursorTs = std::stoll(before);
+            if (!after.empty()) cursorTs = std::stoll(after);
+            if (req.has_param("limit")) limit = (size_t)std::max(1LL, std::stoll(req.get_param_value("limit")));
+        } catch (...) {
+            res.status = 400;
+            res.set_content(R"({"error":"Invalid cursor or limit"})", "application/json");
+            return;
+        }
+
+        MessagePage page = fetchMessagePage(chatType, withUser, email, dir, cursorTs, limit);
+
+        // prevCursor loads the page before this one (null at the start of the
+        // history), nextCursor the messages after it (also the long-poll `since`)
+        json prevCursor = nullptr;
+        std::string nextCursor = std::to_string(cursorTs);
+        if (!page.messages.empty()) {
+            if (dir == PageDirection::Newer || page.more)
+                prevCursor = std::to_string(page.messages.front().timestamp);
+            nextCursor = std::to_string(page.messages.back().timestamp);
+        } else if (dir == PageDirection::Older) {
+            nextCursor = "0";  // nothing before cursorTs: the whole history follows
+        }
+        std::string body = "{\"messages\":";
+        appendMessageArray(body, page.messages);
+        body += ",\"prevCursor\":" + prevCursor.dump() + ",\"nextCursor\":" + json(nextCursor).dump() +
+                ",\"lastSeq\":" + std::to_string(resumeSeq(page.messages, 0)) +
+                ",\"hasMore\":" + (page.more ? "true" : "false") + "}";
+        sendJson(req, res, std::move(body));
       } catch (const std::exception& e) {
         std::cerr << "GET /api/messages error: " << e.what() << std::endl;
         res.status = 500;
@@ -715,6 +2554,70 @@ int main() {
       }
     });
 
+    // GET /api/messages/wait — long-poll: answers as soon as the conversation
+    // has messages newer than `since`, or with an empty list after `timeout` s
+    svr.Get("/api/messages/wait", [](const Request& req, Response& res) {
+      try {
+        json user = extractUser(req);
+        if (user.is_null()) { res.status = 401; res.set_content(R"({"error":"Unauthorized"})", "application/json"); return; }
+
+        std::string chatType = req.get_param_value("chatType");
+        if (chatType.empty()) chatType = "global";
+        std::string withUser = req.get_param_value("with");
+        std::string email = user["email"];
+        if (chatType != "global" && !(chatType == "private" && !withUser.empty())) {
+            res.status = 400;
+            res.set_content(R"({"error":"Unknown conversation"})", "application/json");
+            return;
+        }
+        // `afterSeq` resumes exactly; `since` (timestamp) is kept for old clients
+        bool bySeq = req.has_param("afterSeq");
+        int64_t sinceTs = 0;
+        uint64_t afterSeq = 0;
+        int timeoutSec = LONG_POLL_DEFAULT_SEC;
+        try { if (req.has_param("since")) sinceTs = std::stoll(req.get_param_value("since")); } catch (...) {}
+        try { if (bySeq) afterSeq = std::stoull(req.get_param_value("afterSeq")); } catch (...) {}
+        try { if (req.has_param("timeout")) timeoutSec = std::stoi(req.get_param_value("timeout")); } catch (...) {}
+        timeoutSec = std::max(1, std::min(timeoutSec, LONG_POLL_MAX_SEC));
+
+        std::string key = conversationKey(chatType, email, withUser);
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeoutSec);
+        auto fetch = [&] {
+            return bySeq ? fetchMessagesAfterSeq(chatType, withUser, email, afterSeq, MAX_PAGE_SIZE).messages
+                         : fetchMessages(chatType, withUser, email, sinceTs);
+        };
+        uint64_t seen = changeNotifier.version(key);
+        std::vector<Message> messages = fetch();
+        LongPollGate gate;
+        if (messages.empty() && !gate.tryEnter()) {
+            res.set_header("Retry-After", std::to_string(LONG_POLL_RETRY_MS / 1000));
+            sendJson(req, res, "{\"messages\":[],\"lastSeq\":" + std::to_string(resumeSeq(messages, afterSeq)) +
+                               ",\"retryAfterMs\":" + std::to_string(LONG_POLL_RETRY_MS) + "}");
+            return;
+        }
+        // Wait in 1 s slices so a shutdown is not held up by parked requests
+        while (messages.empty() && !shutdownRequested && std::chrono::steady_clock::now() < deadline) {
+            auto slice = std::min(deadline, std::chrono::steady_clock::now() + std::chrono::seconds(1));
+            uint64_t current;
+            {
+                TracePhase phase("wait");  // parked time; not counted as slow
+                current = changeNotifier.waitForChange(key, seen, slice);
+            }
+            if (current == seen) continue;
+            seen = current;
+            messages = fetch();
+        }
+        std::string body = "{\"messages\":";
+        appendMessageArray(body, messages);
+        body += ",\"lastSeq\":" + std::to_string(resumeSeq(messages, afterSeq)) + "}";
+        sendJson(req, res, std::move(body));
+      } catch (const std::exception& e) {
+        std::cerr << "GET /api/messages/wait error: " << e.what() << std::endl;
+        res.status = 500;
+        res.set_content(json({{"error", e.what()}}).dump(), "application/json");
+      }
+    });
+
     // POST /api/send
     svr.Post("/api/send", [](const Request& req, Response& res) {
         json user = extractUser(req);
@@ -732,26 +2635,42 @@ int main() {
 
         if (chatType == "global") to = "global";
         std::string toName;
-        {
-            std::lock_guard<std::mutex> lock(dataMutex);
-            if (chatType == "private" && users.count(to)) toName = users[to].name;
-        }
+        User recipient;
+        if (chatType == "private" && users.find(to, recipient)) toName = recipient.name;
 
         Message msg{genId(), email, name, avatar, to, toName, messageText, chatType, nowMs()};
 
-        {
-            std::lock_guard<std::mutex> lock(dataMutex);
-            allMessages.push_back(msg);
-            globalQueue.enqueue(msg);
+        // Stamped, numbered and sealed by chatWriter (MongoDB) or indexMessage
+#ifdef USE_MONGODB
+        // Persisted asynchronously by chatWriter; only a full queue delays the ack
+        if (mongoConnected && !writerLease.held()) {
+            res.status = 503;
+            res.set_content(R"({"error":"Chat writes are unavailable on this instance"})", "application/json");
+            return;
         }
+        if (mongoConnected && !chatWriter.enqueue(msg)) {
+            res.status = 503;
+            res.set_content(R"({"error":"Server busy, try again"})", "application/json");
+            return;
+        }
+#endif
 
+        // Local mode acknowledges only once the log record is on disk
+        if (!indexMessage(msg)) {
+            res.status = 500;
+            res.set_content(R"({"error":"Failed to save message"})", "application/json");
+            return;
+        }
+        globalQueue.enqueue(msg);
 #ifdef USE_MONGODB
-        mongoInsertChat(msg, aes_encrypt(messageText, config.encryption_key));
+        if (!mongoConnected)  // otherwise chatWriter notifies once the batch is stored
 #endif
+        changeNotifier.notify(conversationKey(msg));
 
-        res.set_content(json({
-            {"success", true}, {"message", msg.toJson()}
-        }).dump(), "application/json");
+        std::string out = "{\"success\":true,\"message\":";
+        msg.appendJson(out);
+        out += '}';
+        res.set_content(std::move(out), "application/json");
     });
 
     // POST /api/clear
@@ -764,23 +2683,21 @@ int main() {
         std::string withUser = body.value("with", "");
         std::string email = user["email"];
 
-        {
-            std::lock_guard<std::mutex> lock(dataMutex);
-            allMessages.erase(std::remove_if(allMessages.begin(), allMessages.end(),
-                [&](const Message& m) {
-                    if (chatType == "global") return m.chatType == "global";
-                    return m.chatType == "private" &&
-                           ((m.from == email && m.to == withUser) || (m.from == withUser && m.to == email));
-                }), allMessages.end());
-            globalQueue.clear();
+        std::string key = conversationKey(chatType == "global" ? "global" : "private", email, withUser);
+        if (!clearConversation(key)) {
+            res.status = 500;
+            res.set_content(R"({"error":"Failed to clear messages"})", "application/json");
+            return;
         }
+        globalQueue.clear();
 
 #ifdef USE_MONGODB
-        json query;
-        if (chatType == "global") query = {{"chatType", "global"}};
-        else query = {{"chatType", "private"}, {"$or", {{{"from", email}, {"to", withUser}}, {{"from", withUser}, {"to", email}}}}};
-        mongoDeleteChats(query);
+        mongoDeleteChats(mongoChatQuery(chatType, email, withUser).get());
+        messageCache().eraseIf([&](const std::string&, const Message& m) { return conversationKey(m) == key; });
 #endif
+        // Only once the store is cleared: a reader woken earlier would re-read
+        // the deleted messages and cache them under the new ETag
+        changeNotifier.notify(key);
         res.set_content(R"({"success":true})", "application/json");
     });
 
@@ -789,12 +2706,22 @@ int main() {
         json user = extractUser(req);
         if (user.is_null()) { res.status = 401; res.set_content(R"({"error":"Unauthorized"})", "application/json"); return; }
 
-        std::lock_guard<std::mutex> lock(dataMutex);
-        res.set_content(json({
-            {"totalMessages", allMessages.size()},
+        json stats = {
+            {"totalMessages", totalMessages.load()},
             {"totalUsers", users.size()},
-            {"maxQueueSize", 10}
-        }).dump(), "application/json");
+            {"maxQueueSize", globalQueue.capacity()},
+            {"queueSize", globalQueue.size()}
+        };
+#ifdef USE_MONGODB
+        if (mongoPool) stats["mongoPool"] = poolStats.toJson();
+        if (mongoConnected) stats["writeBehind"] = chatWriter.stats();
+        if (mongoConnected) stats["messageCache"] = {
+            {"entries", messageCache().size()}, {"bytes", messageCache().bytesUsed()},
+            {"budgetBytes", messageCache().budget()}, {"hits", messageCache().hits()},
+            {"misses", messageCache().misses()}, {"evictions", messageCache().evictions()}
+        };
+#endif
+        res.set_content(stats.dump(), "application/json");
     });
 
     // GET /api/download
@@ -807,30 +2734,68 @@ int main() {
         std::string withUser = req.get_param_value("with");
         std::string email = user["email"];
 
-        std::ostringstream out;
-        out << std::string(50, '=') << "\n";
-        out << "  ChatApp Logger — " << (chatType == "global" ? "Global Chat" : "DM with " + withUser) << "\n";
-        out << "  Encryption: AES-256 (decrypted for download)\n";
-        out << std::string(50, '=') << "\n\n";
-
-        std::lock_guard<std::mutex> lock(dataMutex);
-        for (auto& msg : allMessages) {
-            bool match = false;
-            if (chatType == "global" && msg.chatType == "global") match = true;
-            if (chatType == "private" &&
-                ((msg.from == email && msg.to == withUser) || (msg.from == withUser && msg.to == email)))
-                match = true;
-            if (match) {
-                time_t t = msg.timestamp / 1000;
-                char buf[64];
-                strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime(&t));
-                out << "[" << buf << "] " << msg.fromName << ":\n  " << msg.content << "\n\n";
+        std::string fmt = req.get_param_value("format");
+        ExportFormat format = fmt == "jsonl" ? ExportFormat::Jsonl
+                            : fmt == "csv"   ? ExportFormat::Csv : ExportFormat::Txt;
+        const char* ext = format == ExportFormat::Jsonl ? "jsonl" : format == ExportFormat::Csv ? "csv" : "txt";
+        const char* mime = format == ExportFormat::Jsonl ? "application/x-ndjson"
+                         : format == ExportFormat::Csv   ? "text/csv" : "text/plain";
+        std::string title = chatType == "global" ? "Global Chat" : "DM with " + withUser;
+        if (notModified(req, res, changeNotifier.etag(conversationKey(chatType, email, withUser)))) return;
+
+        // Streamed in chunks: one decrypted batch in memory at a time,
+        // compressed on the fly when the client accepts it
+        auto source = std::make_shared<ExportSource>(chatType, email, withUser);
+        auto started = std::make_shared<bool>(false);
+        auto encoder = std::make_shared<StreamEncoder>(negotiateDynamic(req.get_header_value("Accept-Encoding")));
+        res.set_header("Content-Disposition", std::string("attachment; filename=\"chat_log.") + ext + "\"");
+        res.set_header("Vary", "Accept-Encoding");
+        if (encoder->encoding() != ContentEncoding::Identity)
+            res.set_header("Content-Encoding", encodingName(encoder->encoding()));
+        res.set_chunked_content_provider(mime, [source, started, encoder, format, title](size_t, DataSink& sink) {
+            std::string chunk;
+            if (!*started) {
+                chunk = exportHeader(format, title);
+                *started = true;
             }
+            for (auto& msg : source->nextBatch()) appendExportLine(chunk, msg, format);
+            if (source->done()) chunk += exportFooter(format);
+            chunk = encoder->update(chunk, source->done());
+            if (!chunk.empty() && !sink.write(chunk.data(), chunk.size())) return false;
+            if (source->done()) sink.done();
+            return true;
+        });
+    });
+
+    // GET /metrics — Prometheus text format
+    metrics.gaugeFn("chat_messages", "Messages held in conversation histories",
+                    [] { return (double)totalMessages.load(); });
+    metrics.gaugeFn("chat_users", "Known users", [] { return (double)users.size(); });
+    metrics.gaugeFn("chat_long_poll_waiters", "Long-polls currently parked", [] { return (double)longPollWaiters.load(); });
+    metrics.gaugeFn("chat_queue_size", "Messages in the visualization queue", [] { return (double)globalQueue.size(); });
+#ifdef USE_MONGODB
+    metrics.gaugeFn("chat_message_cache_bytes", "Decrypted-message cache size",
+                    [] { return (double)messageCache().bytesUsed(); });
+    metrics.counterFn("chat_message_cache_lookups_total", "Decrypted-message cache lookups",
+                      [] { return (double)messageCache().hits(); }, "result=\"hit\"");
+    metrics.counterFn("chat_message_cache_lookups_total", "Decrypted-message cache lookups",
+                      [] { return (double)messageCache().misses(); }, "result=\"miss\"");
+#endif
+    svr.Get("/metrics", [](const Request& req, Response& res) {
+        if (!config.metrics_token.empty() &&
+            !constantTimeEquals(req.get_header_value("Authorization"), "Bearer " + config.metrics_token)) {
+            res.status = 401;
+            res.set_content(R"({"error":"Unauthorized"})", "application/json");
+            return;
         }
-        out << std::string(50, '=') << "\n  End of Chat Log\n" << std::string(50, '=') << "\n";
+        res.set_content(metrics.render(), "text/plain; version=0.0.4; charset=utf-8");
+    });
 
-        res.set_header("Content-Disposition", "attachment; filename=\"chat_log.txt\"");
-        res.set_content(out.str(), "text/plain");
+    // ── Static files: registered last so API routes win ───
+    svr.Get(".*", [](const Request& req, Response& res) {
+        auto asset = req.path.rfind("/api", 0) == 0 ? nullptr : staticAssets.find(req.path);
+        if (asset) sendStaticAsset(req, res, asset);
+        else res.status = 404;
     });
 
     // ── Fallback: serve index.html ONLY for non-API 404s ──
@@ -844,12 +2809,7 @@ int main() {
             return;
         }
         if (res.status == 404) {
-            std::ifstream f("./public/index.html");
-            if (f.is_open()) {
-                std::string html((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
-                res.set_content(html, "text/html");
-                res.status = 200;
-            }
+            if (auto index = staticAssets.find("/index.html")) sendStaticAsset(req, res, index);
         }
     });
 
@@ -858,6 +2818,12 @@ int main() {
     if (!config.mongodb_uri.empty()) {
         try {
             if (mongoConnect()) {
+                writerLease.acquire();  // before reading the last seq another writer may still raise
+                writerLease.start();
+                messageSeq = mongoFindLastSeq();
+                chatWriter.start();
+                users.merge(mongoFindUsers());
+                userRefresher.start();
                 std::cout << "✅ Connected to MongoDB Atlas (ChatLogger)" << std::endl;
             } else {
                 std::cerr << "❌ MongoDB connection failed — running without DB" << std::endl;
@@ -870,6 +2836,21 @@ int main() {
     } else {
         std::cout << "⚠️  MONGODB_URI not set — running in-memory mode" << std::endl;
     }
+#else
+    // ── Replay the local message log ──────────────────────
+    {
+        auto start = std::chrono::steady_clock::now();
+        messageLog.reset(new SegmentedLog(config.data_dir, LOG_SEGMENT_BYTES, config.log_fsync));
+        if (!messageLog->open(replayRecord)) {
+            std::cerr << "❌ Cannot open message log in " << config.data_dir << " — history will not persist" << std::endl;
+            messageLog.reset();
+        } else {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start).count();
+            std::cout << "📜 Replayed " << messageLog->records() << " log records from "
+                      << messageLog->segments() << " segment(s) in " << ms << " ms" << std::endl;
+        }
+    }
 #endif
 
     // ── Start Server ──────────────────────────────────────
@@ -878,7 +2859,7 @@ int main() {
 #ifdef USE_MONGODB
     std::cout << "📦 Database: MongoDB Atlas" << std::endl;
 #else
-    std::cout << "📦 Storage: In-Memory" << std::endl;
+    std::cout << "📦 Storage: In-Memory + log (" << config.data_dir << ")" << std::endl;
 #endif
 #ifdef CPPHTTPLIB_OPENSSL_SUPPORT
     std::cout << "🔒 Encryption: AES-256" << std::endl;
@@ -890,14 +2871,32 @@ int main() {
     std::cout << "⚡ Press Ctrl+C to stop\n" << std::endl;
     std::cout << std::flush;
 
-    if (!svr.listen("0.0.0.0", config.port)) {
+    activeServer = &svr;
+    std::signal(SIGINT, handleShutdownSignal);
+    std::signal(SIGTERM, handleShutdownSignal);
+
+    bool listened = svr.listen("0.0.0.0", config.port);
+    activeServer = nullptr;
+
+#ifdef USE_MONGODB
+    // Flush queued sends before the pool goes away
+    chatWriter.stop();
+    writerLease.stop();
+    userRefresher.stop();
+#endif
+    if (config.static_reload) staticAssets.stopWatching();
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+    googleKeys.stop();
+#endif
+    if (!listened && !shutdownRequested) {
         std::cerr << "❌ Failed to bind to 0.0.0.0:" << config.port << std::endl;
         return 1;
     }
+    std::cout << "Server stopped." << std::endl;
 
 #ifdef USE_MONGODB
-    if (mongoClient) {
-        mongoc_client_destroy(mongoClient);
+    if (mongoPool) {
+        mongoc_client_pool_destroy(mongoPool);
         mongoc_cleanup();
     }
 #endif
@@ -0,0 +1,63 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+// ═══════════════════════════════════════════════════════════
+//  Request Tracing — per-request phase durations
+//  Feeds the Server-Timing header and the slow-request log. A
+//  trace is active only between the pre- and post-routing
+//  handlers of a traced request; otherwise every TracePhase is
+//  a thread_local null check.
+// ═══════════════════════════════════════════════════════════
+
+struct RequestTrace {
+    static const size_t MAX_PHASES = 12;
+    struct Phase {
+        const char* name;
+        uint64_t ns;
+        uint32_t count;
+    };
+    Phase phases[MAX_PHASES];
+    size_t size = 0;
+
+    void add(const char* name, uint64_t ns) {
+        for (size_t i = 0; i < size; i++) {
+            if (std::strcmp(phases[i].name, name) == 0) {
+                phases[i].ns += ns;
+                phases[i].count++;
+                return;
+            }
+        }
+        if (size < MAX_PHASES) phases[size++] = {name, ns, 1};
+    }
+
+    uint64_t ns(const char* name) const {
+        for (size_t i = 0; i < size; i++)
+            if (std::strcmp(phases[i].name, name) == 0) return phases[i].ns;
+        return 0;
+    }
+};
+
+inline thread_local RequestTrace* activeTrace = nullptr;
+
+inline void traceAdd(const char* name, std::chrono::steady_clock::duration d) {
+    if (activeTrace)
+        activeTrace->add(name, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+// Adds the lifetime of its scope to the active trace, if any
+class TracePhase {
+    const char* name_;
+    std::chrono::steady_clock::time_point start_;
+
+public:
+    explicit TracePhase(const char* name) : name_(name) {
+        if (activeTrace) start_ = std::chrono::steady_clock::now();
+    }
+    ~TracePhase() {
+        if (activeTrace) traceAdd(name_, std::chrono::steady_clock::now() - start_);
+    }
+    TracePhase(const TracePhase&) = delete;
+    TracePhase& operator=(const TracePhase&) = delete;
+};
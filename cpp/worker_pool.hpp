@@ -0,0 +1,93 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+
+// ═══════════════════════════════════════════════════════════
+//  Worker Pool — fixed threads for CPU-bound fan-out
+//  (bulk decryption of large result sets)
+// ═══════════════════════════════════════════════════════════
+
+class WorkerPool {
+private:
+    std::vector<std::thread> threads_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mu_;
+    std::condition_variable cv_;
+    bool stop_ = false;
+
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mu_);
+                cv_.wait(lock, [&] { return stop_ || !tasks_.empty(); });
+                if (stop_ && tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+public:
+    explicit WorkerPool(size_t threads) {
+        for (size_t i = 0; i < threads; i++) threads_.emplace_back([this] { run(); });
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& t : threads_) t.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    size_t size() const { return threads_.size(); }
+
+    // Runs fn(i) for every i in [0, n), `grain` indices per chunk.
+    // The calling thread works too and returns once every index is done.
+    void parallelFor(size_t n, size_t grain, const std::function<void(size_t)>& fn) {
+        if (n == 0) return;
+        grain = std::max<size_t>(grain, 1);
+        size_t chunks = (n + grain - 1) / grain;
+        size_t helpers = std::min(threads_.size(), chunks - 1);
+
+        std::atomic<size_t> next{0};
+        auto work = [&] {
+            for (size_t c; (c = next.fetch_add(1)) < chunks;) {
+                size_t end = std::min(n, (c + 1) * grain);
+                for (size_t i = c * grain; i < end; i++) fn(i);
+            }
+        };
+
+        // Helpers reference this stack frame, so wait for all of them
+        std::mutex doneMu;
+        std::condition_variable doneCv;
+        size_t finished = 0;
+        {
+            std::lock_guard<std::mutex> lock(mu_);
+            for (size_t h = 0; h < helpers; h++) {
+                tasks_.emplace_back([&] {
+                    work();
+                    std::lock_guard<std::mutex> l(doneMu);
+                    if (++finished == helpers) doneCv.notify_one();
+                });
+            }
+        }
+        cv_.notify_all();
+
+        work();
+        std::unique_lock<std::mutex> lock(doneMu);
+        doneCv.wait(lock, [&] { return finished == helpers; });
+    }
+};
@@ -11,8 +11,11 @@ let currentChatWith = '';        // email of DM recipient
 let allUsers = [];
 let messageMap = new Map();      // _id -> message object (prevents duplicates)
 let renderedIds = new Set();     // IDs already in the DOM
-let lastSeenTimestamp = 0;
-let refreshInterval = null;
+let lastSeenSeq = 0;             // server sequence number to resume sync after
+let olderCursor = null;          // `before` cursor of the next older page (null = start reached)
+let loadingOlder = false;
+let refreshInterval = null;      // periodic user-list refresh
+let waitController = null;       // AbortController of the parked long-poll
 let queuePanelOpen = false;
 let emojiPickerOpen = false;
 let vantaEffect = null;
@@ -196,6 +199,7 @@ function handleLogout() {
     sessionStorage.removeItem('chatapp_token');
     sessionStorage.removeItem('chatapp_user');
     clearInterval(refreshInterval);
+    stopLongPoll();
     messageMap.clear();
     renderedIds.clear();
 
@@ -230,7 +234,7 @@ function showChatScreen() {
 
         loadUsers();
         switchChat('global');
-        refreshInterval = setInterval(() => pollNewMessages(), 3500);
+        refreshInterval = setInterval(() => loadUsers(), 12000);
 
         setTimeout(() => document.getElementById('messageInput').focus(), 300);
     }, 400);
@@ -323,7 +327,8 @@ function switchChat(chatType, withEmail = '') {
     currentChatWith = withEmail;
     messageMap.clear();
     renderedIds.clear();
-    lastSeenTimestamp = 0;
+    lastSeenSeq = 0;
+    olderCursor = null;
 
     const container = document.getElementById('messagesContainer');
     container.innerHTML = '';
@@ -352,19 +357,25 @@ function switchChat(chatType, withEmail = '') {
     }
     updateDmList();
 
-    // Load messages for this chat (full refresh)
-    loadMessages(true);
+    // Load messages for this chat (full refresh), then wait for new ones
+    stopLongPoll();
+    loadMessages(true).then(restartLongPoll);
 }
 
 // ── Message Loading (SMOOTH — no blink) ───────────────────
+function conversationParams() {
+    const params = new URLSearchParams({ chatType: currentChatType });
+    if (currentChatType === 'private' && currentChatWith) {
+        params.append('with', currentChatWith);
+    }
+    return params;
+}
+
 async function loadMessages(fullRefresh = false) {
     try {
-        const params = new URLSearchParams({ chatType: currentChatType });
-        if (currentChatType === 'private' && currentChatWith) {
-            params.append('with', currentChatWith);
-        }
-        if (!fullRefresh && lastSeenTimestamp > 0) {
-            params.append('since', lastSeenTimestamp);
+        const params = conversationParams();
+        if (!fullRefresh) {
+            params.append('afterSeq', lastSeenSeq);
         }
 
         const res = await apiFetch(`/api/messages?${params}`);
@@ -372,63 +383,147 @@ async function loadMessages(fullRefresh = false) {
         const messages = data.messages || [];
 
         if (fullRefresh) {
-            // Full render (on chat switch)
-            const container = document.getElementById('messagesContainer');
-            container.innerHTML = '';
+            // Full render of the newest page (on chat switch); older pages load on scroll
             messageMap.clear();
-            renderedIds.clear();
-
-            if (messages.length === 0) {
-                container.appendChild(createWelcomeState());
-            } else {
-                messages.forEach((msg, i) => {
-                    messageMap.set(msg._id, msg);
-                    appendMessageToDOM(msg, messages[i - 1], false); // no animate on full load
-                });
-                scrollToBottom(false);
-            }
+            messages.forEach(msg => messageMap.set(msg._id, msg));
+            olderCursor = data.prevCursor ?? null;
+            renderAllMessages();
+            if (messages.length > 0) scrollToBottom(false);
+            lastSeenSeq = data.lastSeq || 0;
+            updateQueueVisualization();
         } else {
-            // Incremental append (polling — SMOOTH)
-            let newCount = 0;
-            messages.forEach(msg => {
-                if (!messageMap.has(msg._id)) {
-                    messageMap.set(msg._id, msg);
-                    const prev = getLastRenderedMessage();
-                    appendMessageToDOM(msg, prev, true); // animate new ones
-                    newCount++;
-                }
-            });
-
-            if (newCount > 0) {
-                // Remove welcome state if present
-                const welcome = document.getElementById('welcomeState');
-                if (welcome) welcome.remove();
-
-                // Auto-scroll if near bottom
-                const container = document.getElementById('messagesContainer');
-                const isNearBottom = container.scrollHeight - container.scrollTop - container.clientHeight < 120;
-                if (isNearBottom) {
-                    scrollToBottom(true);
-                }
-            }
+            applyNewMessages(messages, data.lastSeq);
         }
 
-        // Update last seen timestamp
-        if (messages.length > 0) {
-            lastSeenTimestamp = Math.max(...messages.map(m => m.timestamp));
-        }
+    } catch (error) {
+        console.error('Error loading messages:', error);
+    }
+}
+// Re-renders messageMap in order (no animation)
+function renderAllMessages() {
+    const container = document.getElementById('messagesContainer');
+    container.innerHTML = '';
+    renderedIds.clear();
+    if (messageMap.size === 0) {
+        container.appendChild(createWelcomeState());
+        return;
+    }
+    let prev = null;
+    for (const msg of messageMap.values()) {
+        appendMessageToDOM(msg, prev, false);
+        prev = msg;
+    }
+}
+
+// Prepends the page before olderCursor, keeping the viewport in place
+async function loadOlderMessages() {
+    if (!olderCursor || loadingOlder) return;
+    loadingOlder = true;
+    const chatType = currentChatType, chatWith = currentChatWith;
+    try {
+        const params = conversationParams();
+        params.append('before', olderCursor);
+        const res = await apiFetch(`/api/messages?${params}`);
+        const data = await res.json();
+        if (chatType !== currentChatType || chatWith !== currentChatWith) return;
 
-        updateQueueVisualization();
+        const older = (data.messages || []).filter(m => !messageMap.has(m._id));
+        olderCursor = data.prevCursor ?? null;
+        if (older.length === 0) return;
 
+        const container = document.getElementById('messagesContainer');
+        const fromBottom = container.scrollHeight - container.scrollTop;
+        messageMap = new Map([...older.map(m => [m._id, m]), ...messageMap]);
+        renderAllMessages();
+        container.scrollTop = container.scrollHeight - fromBottom;
     } catch (error) {
-        console.error('Error loading messages:', error);
+        console.error('Error loading older messages:', error);
+    } finally {
+        loadingOlder = false;
+    }
+}
+
+// Incremental append (long-poll — SMOOTH)
+function applyNewMessages(messages, lastSeq) {
+    let newCount = 0;
+    messages.forEach(msg => {
+        if (!messageMap.has(msg._id) && !isOwnEcho(msg)) {
+            messageMap.set(msg._id, msg);
+            const prev = getLastRenderedMessage();
+            appendMessageToDOM(msg, prev, true); // animate new ones
+            newCount++;
+        }
+    });
+
+    if (newCount > 0) {
+        // Remove welcome state if present
+        const welcome = document.getElementById('welcomeState');
+        if (welcome) welcome.remove();
+
+        // Auto-scroll if near bottom
+        const container = document.getElementById('messagesContainer');
+        const isNearBottom = container.scrollHeight - container.scrollTop - container.clientHeight < 120;
+        if (isNearBottom) {
+            scrollToBottom(true);
+        }
     }
+
+    // Resume after everything the server has handed us
+    if (lastSeq) lastSeenSeq = Math.max(lastSeenSeq, lastSeq);
+
+    updateQueueVisualization();
 }
 
-async function pollNewMessages() {
-    await loadMessages(false);
-    // Also refresh user list periodically
-    if (Math.random() < 0.3) loadUsers();
+// The long-poll returns our own sends too, under their stored id (MongoDB
+// assigns a new _id), so match them by sequence number instead
+function isOwnEcho(msg) {
+    if (msg.from !== currentUser?.email || !msg.seq) return false;
+    for (const m of messageMap.values()) {
+        if (m.seq === msg.seq) return true;
+    }
+    return false;
+}
+
+// ── Live Updates (long-poll) ──────────────────────────────
+// One request stays parked on /api/messages/wait until the server has
+// something numbered above lastSeenSeq; switching chats aborts it.
+function restartLongPoll() {
+    stopLongPoll();
+    if (!authToken) return;
+    waitController = new AbortController();
+    longPollLoop(waitController);
+}
+
+function stopLongPoll() {
+    if (waitController) waitController.abort();
+    waitController = null;
+}
+
+async function longPollLoop(controller) {
+    let capDelay = 0;  // grows while the server stays at its waiter cap
+    while (!controller.signal.aborted && authToken) {
+        try {
+            const params = conversationParams();
+            params.append('afterSeq', lastSeenSeq);
+            const res = await apiFetch(`/api/messages/wait?${params}`, { signal: controller.signal });
+            if (!res.ok) throw new Error(`Server error ${res.status}`);
+            const data = await res.json();
+            if (controller.signal.aborted) return;
+            applyNewMessages(data.messages || [], data.lastSeq);
+            // Server is at its waiter cap: poll no faster than it asks, doubling
+            // the delay (up to a minute) while it stays there, spread out
+            if (data.retryAfterMs) {
+                capDelay = capDelay ? Math.min(capDelay * 2, 60000) : data.retryAfterMs;
+                await new Promise(resolve => setTimeout(resolve, capDelay * (1 + 0.5 * Math.random())));
+            } else {
+                capDelay = 0;
+            }
+        } catch (error) {
+            if (controller.signal.aborted) return;
+            console.error('Long-poll error:', error);
+            await new Promise(resolve => setTimeout(resolve, 3000)); // back off, then retry
+        }
+    }
 }
 
 function getLastRenderedMessage() {
@@ -545,7 +640,8 @@ async function sendMessage(event) {
             // Replace optimistic with real
             messageMap.delete(optimisticId);
             messageMap.set(data.message._id, data.message);
-            lastSeenTimestamp = Math.max(lastSeenTimestamp, data.message.timestamp);
+            // lastSeenSeq is not advanced: others' messages may be numbered
+            // below ours and still on their way
         }
     } catch (error) {
         console.error('Send error:', error);
@@ -680,7 +776,8 @@ async function clearCurrentChat() {
         if (res.ok) {
             messageMap.clear();
             renderedIds.clear();
-            lastSeenTimestamp = 0;
+            lastSeenSeq = 0;
+            olderCursor = null;
             const container = document.getElementById('messagesContainer');
             container.innerHTML = '';
             container.appendChild(createWelcomeState());
@@ -747,6 +844,7 @@ function initScrollDetection() {
         const btn = document.getElementById('scrollBottomBtn');
         const isNearBottom = container.scrollHeight - container.scrollTop - container.clientHeight < 100;
         btn.style.display = isNearBottom ? 'none' : 'flex';
+        if (container.scrollTop < 80) loadOlderMessages();
     });
 }
 